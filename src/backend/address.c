@@ -0,0 +1,165 @@
+#include "address.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include "../utils/object_code.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * @struct Folding
+ * @brief Registers of the function being processed
+ */
+typedef struct Folding {
+    int num_regs;
+    int *num_defs; /**< register ID -> number of definitions */
+    IRNode **def;  /**< register ID -> only definition, NULL if none or several */
+} Folding;
+
+/**
+ * @brief Check if an instruction runs before another on every path to it
+ */
+static bool dominates(const IRNode *a, const IRNode *b) {
+    if (a->block != b->block)
+        return cfg_dominates(a->block, b->block);
+    for (const IRNode *node = a; node != b->block->last->next; node = node->next) {
+        if (node == b)
+            return true;
+    }
+    return false;
+}
+
+static const IRNode *single_def(const Folding *f, int reg) {
+    if (reg <= 0 || reg >= f->num_regs || f->num_defs[reg] != 1)
+        return NULL;
+    return f->def[reg];
+}
+
+/**
+ * @brief Check if a register read by `at` keeps its value afterwards, being
+ *        constant or defined once before `at` on every path
+ */
+static bool is_stable(const Folding *f, int reg, const IRNode *at) {
+    if (reg == X0_REGISTER || reg == FP_REGISTER || reg == GP_REGISTER)
+        return true;
+    const IRNode *def = single_def(f, reg);
+    return def != NULL && def->block->rpo >= 0 && dominates(def, at);
+}
+
+/**
+ * @brief Value of a register computed from constants only
+ *
+ * @return true if the register is constant, its value is stored in `value`
+ */
+static bool constant_address(const Folding *f, int reg, long *value) {
+    if (reg == X0_REGISTER || reg == GP_REGISTER) {
+        *value = reg == GP_REGISTER ? GLOBAL_BASE : 0;
+        return true;
+    }
+    const IRNode *def = single_def(f, reg);
+    if (def == NULL || def->block->rpo < 0)
+        return false;
+
+    long a, b;
+    switch (def->instruction) {
+    case LI:
+        *value = (unsigned int)def->imm;
+        return true;
+    case LUI:
+        *value = (unsigned int)def->imm << 12;
+        return true;
+    case MOV:
+        return constant_address(f, def->src1, value);
+    case ADD:
+        if (!constant_address(f, def->src1, &a))
+            return false;
+        if (def->src_kind == CONST_SRC)
+            b = def->imm;
+        else if (!constant_address(f, def->src2, &b))
+            return false;
+        *value = (unsigned int)(a + b);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Address a constant location from `gp`, or from the upper bits of
+ *        the address when it is out of reach
+ */
+static void fold_constant(IR *ir, const Folding *f, IRNode *node) {
+    long address;
+    IRNode *def = single_def(f, node->src1) != NULL ? f->def[node->src1] : NULL;
+    if (def == NULL || !constant_address(f, node->src1, &address) || !dominates(def, node))
+        return;
+    address = (unsigned int)(address + node->imm);
+
+    long from_gp = address - GLOBAL_BASE;
+    if (ir_fits_immediate(from_gp)) {
+        node->src1 = GP_REGISTER;
+        node->imm = from_gp;
+        return;
+    }
+
+    // %hi rounds up when %lo is negative; value numbering merges the new
+    // register with the other ones holding the same upper bits
+    long upper = (unsigned int)(address + 0x800) & ~0xfffu;
+    if (def->instruction == LI && def->imm == upper)
+        return;
+    IRNode *li = new_ir_node(LI);
+    li->dest = register_new_temp(ir);
+    li->imm = upper;
+    ir_insert_after(ir, def, li);
+    node->src1 = li->dest;
+    node->imm = (int)(address - upper);
+}
+
+/**
+ * @brief Fold the definitions of the base register of a load or store
+ */
+static void fold_access(IR *ir, const Folding *f, IRNode *node) {
+    while (true) {
+        const IRNode *def = single_def(f, node->src1);
+        if (def == NULL || def->block->rpo < 0 || !dominates(def, node))
+            break;
+
+        long imm;
+        if (def->instruction == MOV)
+            imm = node->imm;
+        else if (def->instruction == ADD && def->src_kind == CONST_SRC)
+            imm = node->imm + def->imm;
+        else
+            break;
+        if (!ir_fits_immediate(imm) || !is_stable(f, def->src1, def))
+            break;
+
+        node->src1 = def->src1;
+        node->imm = imm;
+    }
+    fold_constant(ir, f, node);
+}
+
+void fold_address_offsets(IR *ir, IRFunction *fn) {
+    Folding f = {0};
+    f.num_regs = ir->next_temp_reg;
+    f.num_defs = (int *)calloc(f.num_regs, sizeof(int));
+    f.def = (IRNode **)calloc(f.num_regs, sizeof(IRNode *));
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node->dest > 0 && f.num_defs[node->dest]++ == 0)
+            f.def[node->dest] = node;
+    }
+
+    CFG *cfg = build_cfg(fn);
+    cfg_dominators(cfg);
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *b = cfg->rpo[i];
+        for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+            if (node->instruction == LOAD || node->instruction == STORE)
+                fold_access(ir, &f, node);
+        }
+    }
+
+    free_cfg(cfg);
+    free(f.def);
+    free(f.num_defs);
+}
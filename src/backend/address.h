@@ -0,0 +1,27 @@
+#ifndef ADDRESS_H
+#define ADDRESS_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Fold address arithmetic into the displacement of the loads and
+ *        stores of a function in SSA form
+ *
+ * A load or store whose base register is `mv a, b` or `addi a, b, c` reads
+ * `b` instead, with `c` added to its displacement, as long as the result
+ * still fits in 12 bits. This repeats along chains of such definitions, so
+ * the element `g[3]` of a global array becomes `lw rd, 12+off(gp)` once
+ * constant propagation has turned the index into an `addi`.
+ *
+ * `b` must be `x0`, `fp`, `gp` or a virtual register whose only definition
+ * dominates the one of `a`, which itself must dominate the access: a
+ * variable read before being assigned keeps one definition, which may run
+ * again between the two. The definitions of `a` left without uses are
+ * removed later by dead code elimination.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function in SSA form (see ssa.h)
+ */
+void fold_address_offsets(IR *ir, IRFunction *fn);
+
+#endif // ADDRESS_H
@@ -1,7 +1,10 @@
 #include "cgen.h"
+#include "../global.h"
 #include "../parser.tab.h"
 #include "../utils/ast.h"
 #include "../utils/ir.h"
+#include "../utils/object_code.h"
+#include "../utils/queue.h"
 #include "../utils/symtab.h"
 #include <stdio.h>
 #include <string.h>
@@ -10,6 +13,8 @@
 static void gen_code(ASTNode *node, IR *ir);
 static int calculate_local_size(ASTNode *node);
 static IRNode *gen_condition(ASTNode *node, IR *ir);
+static int global_base(IR *ir, const BucketList *bucket, int *offset);
+static int gen_args(ASTNode *arg, IR *ir);
 
 /**
  * @brief A global pointer to the function node being generated.
@@ -17,11 +22,30 @@ static IRNode *gen_condition(ASTNode *node, IR *ir);
  */
 static ASTNode *func;
 
+/**
+ * @brief Jumps to the epilogue emitted by the 'return' statements of the current
+ * function. They are patched with the epilogue label once it is generated.
+ */
+static Queue *return_jumps;
+
+/**
+ * @brief Label at the start of the body of the function being generated, after
+ * the params are promoted. A 'return' of a call to the function itself assigns the
+ * params and jumps there instead. NULL when the function can not loop this way.
+ */
+static IRNode *tail_entry;
+
+/**
+ * @brief Number of self tail calls jumping to 'tail_entry', the label is removed if
+ * there are none.
+ */
+static int tail_calls;
+
 IR *gen_ir(ASTNode *tree) {
     IR *ir = new_ir();
 
     ir_insert_comment(ir, "program entry: call main");
-    ir_insert_call(ir, "main");
+    ir_insert_call(ir, "main", 0);
     ir_insert_comment(ir, "syscall Exit (a7 = 10)");
     ir_insert_addi(ir, A7_REGISTER, X0_REGISTER, 10);
     ir_insert_ecall(ir);
@@ -56,12 +80,15 @@ void gen_code(ASTNode *node, IR *ir) {
             ASTNode *var_node = node->child[0];
             BucketList *bucket = st_lookup(var_node->attr.name, var_node->scope);
 
-            if (var_node->scope == 0) {
-                int base_addr_reg = register_new_temp(ir);
-                ir_insert_li(ir, base_addr_reg, bucket->address);
+            if (bucket->reg != 0 && var_node->child[0] == NULL) {
+                ir_insert_comment(ir, "promoted: var <- rs2");
+                ir_insert_mov(ir, bucket->reg, rs2);
+            } else if (var_node->scope == 0) {
+                int offset;
+                int base_addr_reg = global_base(ir, bucket, &offset);
                 if (var_node->child[0] == NULL) {
-                    ir_insert_comment(ir, "store: mem[addr] <- rs2");
-                    ir_insert_store(ir, rs2, 0, base_addr_reg);
+                    ir_insert_comment(ir, "store: mem[offset+rs1] <- rs2");
+                    ir_insert_store(ir, rs2, offset, base_addr_reg);
                 } else {
                     gen_code(var_node->child[0], ir);
                     int idx_reg = var_node->child[0]->temp_reg;
@@ -69,8 +96,8 @@ void gen_code(ASTNode *node, IR *ir) {
                     ir_insert_slli(ir, offset_reg, idx_reg, 2); // 4-byte integer
                     int addr_reg = register_new_temp(ir);
                     ir_insert_add(ir, addr_reg, base_addr_reg, offset_reg);
-                    ir_insert_comment(ir, "store: mem[rs1] <- rs2");
-                    ir_insert_store(ir, rs2, 0, addr_reg);
+                    ir_insert_comment(ir, "store: mem[offset+rs1] <- rs2");
+                    ir_insert_store(ir, rs2, offset, addr_reg);
                 }
             } else {
                 if (var_node->child[0] == NULL) {
@@ -83,10 +110,14 @@ void gen_code(ASTNode *node, IR *ir) {
                     ir_insert_slli(ir, offset_reg, idx_reg, 2); // 4-byte integer
                     int addr_reg = register_new_temp(ir);
 
-                    if (bucket->offset > 0) { // param var
-                        ir_insert_comment(ir, "load address: rd <- mem[offset+fp]");
-                        ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
-                        ir_insert_add(ir, addr_reg, addr_reg, offset_reg);
+                    if (bucket->node->kind.expr == ParamArr) { // param array
+                        int base_reg = bucket->reg;
+                        if (base_reg == 0) {
+                            ir_insert_comment(ir, "load address: rd <- mem[offset+fp]");
+                            ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
+                            base_reg = addr_reg;
+                        }
+                        ir_insert_add(ir, addr_reg, base_reg, offset_reg);
                         ir_insert_comment(ir, "store: mem[offset+rs1] <- rs2");
                         ir_insert_store(ir, rs2, 0, addr_reg);
                     } else { // local var
@@ -164,6 +195,28 @@ void gen_code(ASTNode *node, IR *ir) {
         }
 
         case Return: {
+            ASTNode *call = node->child[0];
+            if (tail_entry != NULL && call != NULL && call->node_kind == Expr &&
+                call->kind.expr == FuncCall && strcmp(call->attr.name, func->attr.name) == 0) {
+                ir_insert_comment(ir, "self tail call: params <- args, goto body");
+                gen_args(call->child[0], ir);
+                // an arg may read a param assigned before it
+                for (ASTNode *arg = call->child[0]; arg != NULL; arg = arg->sibling) {
+                    int copy = register_new_temp(ir);
+                    ir_insert_mov(ir, copy, arg->temp_reg);
+                    arg->temp_reg = copy;
+                }
+                ASTNode *arg = call->child[0];
+                for (ASTNode *param = func->child[0]; param != NULL; param = param->sibling) {
+                    ir_insert_mov(ir, st_lookup(param->attr.name, param->scope)->reg, arg->temp_reg);
+                    arg = arg->sibling;
+                }
+                IRNode *jump = ir_insert_jump(ir, tail_entry->comment);
+                jump->target = tail_entry;
+                tail_calls++;
+                break;
+            }
+
             if (node->child[0] != NULL) {
                 gen_code(node->child[0], ir);
                 ir_insert_comment(ir, "a0 <- rs1");
@@ -172,7 +225,7 @@ void gen_code(ASTNode *node, IR *ir) {
             ir_insert_comment(ir, "jump to function epilogue");
             char label[256];
             snprintf(label, sizeof(label), "end_%s", func->attr.name);
-            ir_insert_jump(ir, label);
+            q_push(return_jumps, ir_insert_jump(ir, label));
             break;
         }
 
@@ -184,12 +237,15 @@ void gen_code(ASTNode *node, IR *ir) {
             ASTNode *var_node = node->child[0];
             BucketList *bucket = st_lookup(var_node->attr.name, var_node->scope);
 
-            if (var_node->scope == 0) {
-                int base_addr_reg = register_new_temp(ir);
-                ir_insert_li(ir, base_addr_reg, bucket->address);
+            if (bucket->reg != 0 && var_node->child[0] == NULL) {
+                ir_insert_comment(ir, "promoted: var <- a0");
+                ir_insert_mov(ir, bucket->reg, A0_REGISTER);
+            } else if (var_node->scope == 0) {
+                int offset;
+                int base_addr_reg = global_base(ir, bucket, &offset);
                 if (var_node->child[0] == NULL) {
-                    ir_insert_comment(ir, "store: mem[addr] <- a0");
-                    ir_insert_store(ir, A0_REGISTER, 0, base_addr_reg);
+                    ir_insert_comment(ir, "store: mem[offset+rs1] <- a0");
+                    ir_insert_store(ir, A0_REGISTER, offset, base_addr_reg);
                 } else {
                     gen_code(var_node->child[0], ir);
                     int idx_reg = var_node->child[0]->temp_reg;
@@ -197,8 +253,8 @@ void gen_code(ASTNode *node, IR *ir) {
                     ir_insert_slli(ir, offset_reg, idx_reg, 2); // 4-byte integer
                     int addr_reg = register_new_temp(ir);
                     ir_insert_add(ir, addr_reg, base_addr_reg, offset_reg);
-                    ir_insert_comment(ir, "store: mem[rs1] <- a0");
-                    ir_insert_store(ir, A0_REGISTER, 0, addr_reg);
+                    ir_insert_comment(ir, "store: mem[offset+rs1] <- a0");
+                    ir_insert_store(ir, A0_REGISTER, offset, addr_reg);
                 }
             } else {
                 if (var_node->child[0] == NULL) {
@@ -211,10 +267,14 @@ void gen_code(ASTNode *node, IR *ir) {
                     ir_insert_slli(ir, offset_reg, idx_reg, 2); // 4-byte integer
                     int addr_reg = register_new_temp(ir);
 
-                    if (bucket->offset > 0) { // param var
-                        ir_insert_comment(ir, "load address: rd <- mem[offset+fp]");
-                        ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
-                        ir_insert_add(ir, addr_reg, addr_reg, offset_reg);
+                    if (bucket->node->kind.expr == ParamArr) { // param array
+                        int base_reg = bucket->reg;
+                        if (base_reg == 0) {
+                            ir_insert_comment(ir, "load address: rd <- mem[offset+fp]");
+                            ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
+                            base_reg = addr_reg;
+                        }
+                        ir_insert_add(ir, addr_reg, base_reg, offset_reg);
                         ir_insert_comment(ir, "store: mem[offset+rs1] <- a0");
                         ir_insert_store(ir, A0_REGISTER, 0, addr_reg);
                     } else { // local var
@@ -284,14 +344,20 @@ void gen_code(ASTNode *node, IR *ir) {
         case Var:
         case Arr: {
             BucketList *bucket = st_lookup(node->attr.name, node->scope);
+            if (bucket->reg != 0 && node->child[0] == NULL) {
+                // expressions have no side effects, the variable itself is the value
+                node->temp_reg = bucket->reg;
+                break;
+            }
+
             int value_reg = register_new_temp(ir);
 
             if (node->scope == 0) {
-                int base_addr_reg = register_new_temp(ir);
-                ir_insert_li(ir, base_addr_reg, bucket->address);
+                int offset;
+                int base_addr_reg = global_base(ir, bucket, &offset);
                 if (node->child[0] == NULL) {
-                    ir_insert_comment(ir, "load: rd <- mem[addr]");
-                    ir_insert_load(ir, value_reg, 0, base_addr_reg);
+                    ir_insert_comment(ir, "load: rd <- mem[offset+rs1]");
+                    ir_insert_load(ir, value_reg, offset, base_addr_reg);
                 } else {
                     gen_code(node->child[0], ir);
                     int idx_reg = node->child[0]->temp_reg;
@@ -299,8 +365,8 @@ void gen_code(ASTNode *node, IR *ir) {
                     ir_insert_slli(ir, offset_reg, idx_reg, 2); // 4-byte integer
                     int addr_reg = register_new_temp(ir);
                     ir_insert_add(ir, addr_reg, base_addr_reg, offset_reg);
-                    ir_insert_comment(ir, "load: rd <- mem[rs1]");
-                    ir_insert_load(ir, value_reg, 0, addr_reg);
+                    ir_insert_comment(ir, "load: rd <- mem[offset+rs1]");
+                    ir_insert_load(ir, value_reg, offset, addr_reg);
                 }
             } else {
                 if (node->child[0] == NULL) {
@@ -313,10 +379,14 @@ void gen_code(ASTNode *node, IR *ir) {
                     ir_insert_slli(ir, offset_reg, idx_reg, 2); // 4-byte integer
                     int addr_reg = register_new_temp(ir);
 
-                    if (bucket->offset > 0) { // param var
-                        ir_insert_comment(ir, "load address: rd <- mem[offset+fp]");
-                        ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
-                        ir_insert_add(ir, addr_reg, addr_reg, offset_reg);
+                    if (bucket->node->kind.expr == ParamArr) { // param array
+                        int base_reg = bucket->reg;
+                        if (base_reg == 0) {
+                            ir_insert_comment(ir, "load address: rd <- mem[offset+fp]");
+                            ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
+                            base_reg = addr_reg;
+                        }
+                        ir_insert_add(ir, addr_reg, base_reg, offset_reg);
                         ir_insert_comment(ir, "load: rd <- mem[offset+rs1]");
                         ir_insert_load(ir, value_reg, 0, addr_reg);
                     } else { // local var
@@ -333,7 +403,8 @@ void gen_code(ASTNode *node, IR *ir) {
 
         case FuncDecl: {
             ir_insert_comment(ir, "func begin");
-            ir_insert_label(ir, node->attr.name);
+            IRNode *entry = ir_insert_label(ir, node->attr.name);
+            IRFunction *fn = ir_new_function(ir, node->attr.name, entry);
 
             // store preserved registers
             ir_insert_comment(ir, "func prologue");
@@ -341,24 +412,81 @@ void gen_code(ASTNode *node, IR *ir) {
             ir_insert_store(ir, RA_REGISTER, 4, SP_REGISTER);
             ir_insert_store(ir, FP_REGISTER, 0, SP_REGISTER);
             ir_insert_mov(ir, FP_REGISTER, SP_REGISTER);
+            fn->prologue = ir->tail;
 
-            // Pre-pass to calculate stack size
+            // Pre-pass to calculate stack size, -O0 also stores the register params
+            int num_params = 0;
+            for (ASTNode *param = node->child[0]; param != NULL; param = param->sibling)
+                num_params++;
             int local_size = calculate_local_size(node->child[1]);
+            if (OptLevel < 1)
+                local_size += 4 * (num_params < ARG_REGISTERS ? num_params : ARG_REGISTERS);
+            fn->frame_size = local_size;
             if (local_size > 0) {
                 ir_insert_addi(ir, SP_REGISTER, SP_REGISTER, -local_size);
+                fn->frame = ir->tail;
+                fn->prologue = ir->tail;
+            }
+
+            // the first params arrive in a0-a7 and the next ones above fp; from -O1
+            // on they are promoted, later reads and writes use their registers
+            int arg = 0;
+            for (ASTNode *param = node->child[0]; param != NULL; param = param->sibling, arg++) {
+                BucketList *bucket = st_lookup(param->attr.name, param->scope);
+                char comment[64];
+                if (OptLevel < 1) {
+                    if (arg < ARG_REGISTERS) {
+                        snprintf(comment, sizeof(comment), "store param: mem[offset+fp] <- a%d", arg);
+                        ir_insert_comment(ir, comment);
+                        ir_insert_store(ir, A0_REGISTER - arg, bucket->offset, FP_REGISTER);
+                    }
+                    continue;
+                }
+                bucket->reg = register_new_temp(ir);
+                if (arg < ARG_REGISTERS) {
+                    snprintf(comment, sizeof(comment), "promote param: var <- a%d", arg);
+                    ir_insert_comment(ir, comment);
+                    ir_insert_mov(ir, bucket->reg, A0_REGISTER - arg);
+                } else {
+                    ir_insert_comment(ir, "promote param: var <- mem[offset+fp]");
+                    ir_insert_load(ir, bucket->reg, bucket->offset, FP_REGISTER);
+                }
             }
 
             // Func Body
             ASTNode *old_func = func;
+            Queue *old_return_jumps = return_jumps;
+            IRNode *old_tail_entry = tail_entry;
+            int old_tail_calls = tail_calls;
             func = node;
+            return_jumps = q_create();
             ir_insert_comment(ir, "func body");
+
+            // every iteration would share the local arrays, which a param may point to
+            tail_entry = NULL;
+            tail_calls = 0;
+            if (OptLevel >= 1 && local_size == 0) {
+                char tail_label[256];
+                snprintf(tail_label, sizeof(tail_label), "tail_%s", node->attr.name);
+                tail_entry = ir_insert_label(ir, tail_label);
+            }
             gen_code(node->child[1], ir);
+            if (tail_entry != NULL && tail_calls == 0)
+                ir_remove(ir, tail_entry);
 
             // Func Epilogue
             ir_insert_comment(ir, "func epilogue");
             char label[256];
             snprintf(label, sizeof(label), "end_%s", node->attr.name);
-            ir_insert_label(ir, label);
+            IRNode *epilogue = ir_insert_label(ir, label);
+            fn->epilogue = epilogue;
+
+            // goto epilogue
+            while (!q_empty(return_jumps)) {
+                IRNode *jump = q_front(return_jumps);
+                jump->target = epilogue;
+                q_pop(return_jumps);
+            }
 
             // restore registers
             ir_insert_mov(ir, SP_REGISTER, FP_REGISTER);
@@ -367,64 +495,42 @@ void gen_code(ASTNode *node, IR *ir) {
             ir_insert_addi(ir, SP_REGISTER, SP_REGISTER, 8);
 
             // return to caller
-            ir_insert_jump_reg(ir, RA_REGISTER);
-
+            fn->exit = ir_insert_jump_reg(ir, RA_REGISTER);
+            if (node->type != Void)
+                fn->exit->src2 = A0_REGISTER; // the return value is live until here
+
+            q_destroy(return_jumps);
+            return_jumps = old_return_jumps;
+            tail_entry = old_tail_entry;
+            tail_calls = old_tail_calls;
             func = old_func;
             break;
         }
 
         case FuncCall: {
-            ASTNode *arg = node->child[0];
-            int arg_count = 0, count = 0;
-            ir_insert_comment(ir, "push arguments");
-
-            while (arg != NULL) {
-                arg_count++;
-                arg = arg->sibling;
+            // every argument is evaluated before a0-a7 are set, a nested call clobbers them
+            int arg_count = gen_args(node->child[0], ir);
+
+            // the arguments after the eighth are pushed, in order
+            int stack_args = arg_count > ARG_REGISTERS ? arg_count - ARG_REGISTERS : 0;
+            if (stack_args > 0) {
+                ir_insert_comment(ir, "push arguments");
+                ir_insert_addi(ir, SP_REGISTER, SP_REGISTER, -stack_args * 4);
             }
-            arg = node->child[0];
-            if (arg_count > 0)
-                ir_insert_addi(ir, SP_REGISTER, SP_REGISTER, -arg_count * 4);
-
-            while (arg != NULL) {
-                ASTNode *next_arg = arg->sibling; // avoid generation of args code multiple times
-                arg->sibling = NULL;
-
-                if (arg->kind.expr == Arr && arg->child[0] == NULL) {
-                    ir_insert_comment(ir, "push array arg");
-                    BucketList *bucket = st_lookup(arg->attr.name, arg->scope);
-                    int addr_reg = register_new_temp(ir);
-                    if (arg->scope == 0) {
-                        ir_insert_comment(ir, "load global adddres: rd <- addr");
-                        ir_insert_li(ir, addr_reg, bucket->address);
-                    } else {
-                        if (bucket->node->kind.expr == ParamArr) {
-                            ir_insert_comment(ir, "load address from arg: rd <- mem[offset+fp]");
-                            ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
-                        } else {
-                            ir_insert_comment(ir, "load local address: rd <- fp+offset");
-                            ir_insert_addi(ir, addr_reg, FP_REGISTER, bucket->offset);
-                        }
-                    }
-                    arg->temp_reg = addr_reg;
-                } else {
-                    ir_insert_comment(ir, "push other arg");
-                    gen_code(arg, ir);
-                }
-
-                arg->sibling = next_arg;
-
-                ir_insert_store(ir, arg->temp_reg, count * 4, SP_REGISTER);
-                count++;
-                arg = arg->sibling;
+            int count = 0;
+            for (ASTNode *arg = node->child[0]; arg != NULL; arg = arg->sibling, count++) {
+                if (count < ARG_REGISTERS)
+                    ir_insert_mov(ir, A0_REGISTER - count, arg->temp_reg);
+                else
+                    ir_insert_store(ir, arg->temp_reg, (count - ARG_REGISTERS) * 4, SP_REGISTER);
             }
 
             // call the function
-            ir_insert_call(ir, node->attr.name);
+            ir_insert_call(ir, node->attr.name, arg_count - stack_args);
 
-            if (arg_count > 0) {
+            if (stack_args > 0) {
                 ir_insert_comment(ir, "restore stack");
-                ir_insert_addi(ir, SP_REGISTER, SP_REGISTER, arg_count * 4);
+                ir_insert_addi(ir, SP_REGISTER, SP_REGISTER, stack_args * 4);
             }
 
             node->temp_reg = register_new_temp(ir);
@@ -434,6 +540,11 @@ void gen_code(ASTNode *node, IR *ir) {
         }
 
         case VarDecl:
+            // from -O1 on local scalars live in a virtual register instead of the frame
+            if (OptLevel >= 1 && node->scope != 0)
+                st_lookup(node->attr.name, node->scope)->reg = register_new_temp(ir);
+            break;
+
         case ArrDecl:
         case ParamVar:
         case ParamArr:
@@ -445,6 +556,53 @@ void gen_code(ASTNode *node, IR *ir) {
     gen_code(node->sibling, ir);
 }
 
+/**
+ * @brief Evaluates the arguments of a call, each one into its 'temp_reg'.
+ *
+ * @param arg The first argument, the others are its siblings.
+ * @param ir The IR structure.
+ * @return The number of arguments.
+ */
+static int gen_args(ASTNode *arg, IR *ir) {
+    int arg_count = 0;
+    ir_insert_comment(ir, "evaluate arguments");
+
+    while (arg != NULL) {
+        ASTNode *next_arg = arg->sibling; // avoid generation of args code multiple times
+        arg->sibling = NULL;
+
+        if (arg->kind.expr == Arr && arg->child[0] == NULL) {
+            ir_insert_comment(ir, "array arg");
+            BucketList *bucket = st_lookup(arg->attr.name, arg->scope);
+            int addr_reg = register_new_temp(ir);
+            if (arg->scope == 0) {
+                int offset;
+                int base_addr_reg = global_base(ir, bucket, &offset);
+                ir_insert_comment(ir, "load global address: rd <- rs1+offset");
+                ir_insert_addi(ir, addr_reg, base_addr_reg, offset);
+            } else if (bucket->node->kind.expr == ParamArr && bucket->reg != 0) {
+                addr_reg = bucket->reg;
+            } else if (bucket->node->kind.expr == ParamArr) {
+                ir_insert_comment(ir, "load address from arg: rd <- mem[offset+fp]");
+                ir_insert_load(ir, addr_reg, bucket->offset, FP_REGISTER);
+            } else {
+                ir_insert_comment(ir, "load local address: rd <- fp+offset");
+                ir_insert_addi(ir, addr_reg, FP_REGISTER, bucket->offset);
+            }
+            arg->temp_reg = addr_reg;
+        } else {
+            ir_insert_comment(ir, "other arg");
+            gen_code(arg, ir);
+        }
+
+        arg->sibling = next_arg;
+        arg_count++;
+        arg = arg->sibling;
+    }
+
+    return arg_count;
+}
+
 /**
  * @brief Recursively calculates the total size needed for all local variable
  * declarations within a function's body, including nested blocks.
@@ -461,7 +619,7 @@ static int calculate_local_size(ASTNode *node) {
         ASTNode *decl = node->child[0];
         while (decl != NULL) {
             if (decl->node_kind == Expr) {
-                if (decl->kind.expr == VarDecl) {
+                if (decl->kind.expr == VarDecl && OptLevel < 1) {
                     size += 4;
                 } else if (decl->kind.expr == ArrDecl) {
                     size += decl->child[0]->attr.val * 4;
@@ -479,6 +637,35 @@ static int calculate_local_size(ASTNode *node) {
     return size;
 }
 
+/**
+ * @brief Selects the base register and displacement that address a global
+ * variable.
+ *
+ * Globals within the 12-bit reach of `gp` are addressed from it directly.
+ * The others get the upper 20 bits of their address in a new register with
+ * `lui`, and the lower 12 bits (%lo) as the displacement.
+ *
+ * @param ir The IR structure.
+ * @param bucket The symbol table entry of the global variable.
+ * @param offset Set to the displacement to add to the base register.
+ * @return The base register.
+ */
+static int global_base(IR *ir, const BucketList *bucket, int *offset) {
+    long from_gp = (long)bucket->address - GLOBAL_BASE;
+    if (ir_fits_immediate(from_gp)) {
+        *offset = (int)from_gp;
+        return GP_REGISTER;
+    }
+
+    // %hi rounds up when %lo is negative, since the displacement is signed
+    int upper = (int)((bucket->address + 0x800) >> 12);
+    *offset = (int)(bucket->address - ((unsigned int)upper << 12));
+    int base_reg = register_new_temp(ir);
+    ir_insert_comment(ir, "load global address: rd <- %hi(addr)");
+    ir_insert_lui(ir, base_reg, upper);
+    return base_reg;
+}
+
 /**
  * @brief Generates the conditional branch instruction for an 'if' or 'while' statement.
  *
@@ -0,0 +1,283 @@
+#include "dce.h"
+#include "../utils/bitset.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/** Bit of the frame liveness sets standing for every local array */
+#define ARRAYS 0
+
+/**
+ * @struct Frame
+ * @brief Frame objects of a function tracked by the dead store pass
+ *
+ * Bit 0 stands for the local arrays, then every `fp` offset accessed
+ * directly has its own bit.
+ */
+typedef struct Frame {
+    IRFunction *fn;
+    int *offsets; /**< bit - 1 -> offset from `fp` */
+    int num_offsets;
+    int num_regs;
+    IRNode **def; /**< register ID -> only definition, NULL if none or several */
+    BasicBlock *epilogue;
+    bool escapes; /**< a callee may read the frame, see `frame_escapes` */
+} Frame;
+
+/**
+ * @brief Remove the instructions of the blocks not reachable from the entry
+ */
+static void remove_unreachable(IR *ir, IRFunction *fn) {
+    CFG *cfg = build_cfg(fn);
+    BasicBlock *epilogue = fn->epilogue->block;
+    for (int i = 0; i < cfg->num_blocks; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        if (b->rpo >= 0 || b == epilogue)
+            continue;
+        IRNode *end = b->last->next;
+        for (IRNode *node = b->first, *next; node != end; node = next) {
+            next = node->next;
+            if (node->instruction != COMMENT)
+                ir_remove(ir, node);
+        }
+    }
+    free_cfg(cfg);
+}
+
+static int offset_bit(const Frame *f, int offset) {
+    for (int i = 0; i < f->num_offsets; i++) {
+        if (f->offsets[i] == offset)
+            return i + 1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Check if a register holds `fp` plus an offset (e.g. the address of
+ *        a local array element)
+ */
+static bool is_frame_address(const Frame *f, int reg) {
+    if (reg <= 0 || reg >= f->num_regs || f->def[reg] == NULL)
+        return false;
+
+    const IRNode *def = f->def[reg];
+    if (def->instruction == MOV)
+        return def->src1 == FP_REGISTER;
+    return def->instruction == ADD &&
+           (def->src1 == FP_REGISTER || (def->src_kind == REG_SRC && def->src2 == FP_REGISTER));
+}
+
+/**
+ * @brief Check if an address in the frame is used other than by a load or
+ *        store, so a callee may read the frame through it
+ */
+static bool frame_escapes(const Frame *f) {
+    // the prologue saves the caller's `fp`, not an address in this frame
+    for (IRNode *node = f->fn->prologue->next; node != f->epilogue->first; node = node->next) {
+        bool derives = is_frame_address(f, node->dest) || node->dest == FP_REGISTER;
+        if ((node->src1 == FP_REGISTER || is_frame_address(f, node->src1)) && !derives &&
+            node->instruction != LOAD && node->instruction != STORE)
+            return true;
+        if ((node->src2 == FP_REGISTER || is_frame_address(f, node->src2)) && !derives)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Frame object accessed by a load or store
+ *
+ * @return Bit of the object, `ARRAYS` for an address computed from `fp`,
+ *         -1 for any other address
+ */
+static int frame_object(const Frame *f, const IRNode *node) {
+    if (node->src1 == FP_REGISTER)
+        return offset_bit(f, (int)node->imm);
+    if (node->src1 <= 0 || node->src1 >= f->num_regs)
+        return -1;
+
+    return is_frame_address(f, node->src1) ? ARRAYS : -1;
+}
+
+static void set_all(BitSet *live, int num_bits) {
+    for (int i = 0; i < num_bits; i++)
+        bitset_set(live, i);
+}
+
+/**
+ * @brief Update the live frame objects before an instruction from the ones
+ *        live after it
+ */
+static void frame_transfer(const Frame *f, const IRNode *node, BitSet *live) {
+    if (node->instruction == CALL) {
+        if (f->escapes)
+            set_all(live, f->num_offsets + 1);
+    } else if (node->instruction == STORE) {
+        int bit = frame_object(f, node);
+        if (bit > ARRAYS)
+            bitset_clear(live, bit);
+    } else if (node->instruction == LOAD) {
+        // the epilogue only reloads the saved `ra` and `fp`
+        if (node->block == f->epilogue && node->src1 == SP_REGISTER)
+            return;
+        int bit = frame_object(f, node);
+        if (bit < 0) {
+            // only an address that escaped can lead back to the frame
+            if (f->escapes)
+                set_all(live, f->num_offsets + 1);
+        } else if (bit == ARRAYS) {
+            // the slots include the elements folded into `fp` displacements
+            set_all(live, f->num_offsets + 1);
+        } else {
+            // a slot may also be an array element with a constant index
+            bitset_set(live, bit);
+            bitset_set(live, ARRAYS);
+        }
+    }
+}
+
+static void frame_live_in(const Frame *f, const BasicBlock *b, BitSet *live) {
+    for (IRNode *node = b->last; node != b->first->prev; node = node->prev)
+        frame_transfer(f, node, live);
+}
+
+/**
+ * @brief Remove the stores to frame objects that are never read afterwards
+ */
+static void remove_dead_stores(IR *ir, Frame *f) {
+    IRFunction *fn = f->fn;
+    int capacity = 8;
+    f->offsets = (int *)malloc(capacity * sizeof(int));
+    f->num_offsets = 0;
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if ((node->instruction != LOAD && node->instruction != STORE) ||
+            node->src1 != FP_REGISTER || offset_bit(f, (int)node->imm) >= 0)
+            continue;
+        if (f->num_offsets == capacity) {
+            capacity *= 2;
+            f->offsets = (int *)realloc(f->offsets, capacity * sizeof(int));
+        }
+        f->offsets[f->num_offsets++] = (int)node->imm;
+    }
+
+    CFG *cfg = build_cfg(fn);
+    int n = cfg->num_blocks, num_bits = f->num_offsets + 1;
+    f->epilogue = fn->epilogue->block;
+    f->escapes = frame_escapes(f);
+    BitSet *live_in = new_bitset_slab(2 * n, num_bits);
+    BitSet *live_out = &live_in[n];
+    BitSet *live = new_bitset(num_bits);
+
+    // nothing in the frame is read after the function returns
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = cfg->num_reachable - 1; i >= 0; i--) {
+            BasicBlock *b = cfg->rpo[i];
+            bitset_clear_all(&live_out[b->id]);
+            for (int k = 0; k < b->num_succs; k++)
+                bitset_union(&live_out[b->id], &live_in[b->succ[k]->id]);
+            bitset_assign(live, &live_out[b->id]);
+            frame_live_in(f, b, live);
+            if (!bitset_equals(live, &live_in[b->id])) {
+                bitset_assign(&live_in[b->id], live);
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *b = cfg->rpo[i];
+        bitset_assign(live, &live_out[b->id]);
+        IRNode *stop = b->first->prev;
+        for (IRNode *node = b->last, *prev; node != stop; node = prev) {
+            prev = node->prev;
+            if (node->instruction == STORE) {
+                int bit = frame_object(f, node);
+                if (bit >= 0 && !bitset_test(live, bit)) {
+                    ir_remove(ir, node);
+                    continue;
+                }
+            }
+            frame_transfer(f, node, live);
+        }
+    }
+
+    destroy_biset(live);
+    destroy_bitset_slab(live_in);
+    free_cfg(cfg);
+    free(f->offsets);
+}
+
+/**
+ * @brief One sweep removing the pure instructions whose result is dead
+ *
+ * @return true if an instruction was removed
+ */
+static bool remove_dead_instructions(IR *ir, IRFunction *fn, const int *local, int num_regs) {
+    CFG *cfg = build_cfg(fn);
+    cfg_liveness(cfg, local, num_regs);
+    BitSet *live = new_bitset(num_regs);
+    int regs[NUM_REGISTERS];
+    bool removed = false;
+
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *b = cfg->rpo[i];
+        bitset_assign(live, b->live_out);
+        IRNode *stop = b->first->prev;
+        for (IRNode *node = b->last, *prev; node != stop; node = prev) {
+            prev = node->prev;
+            if (ir_is_pure(node) && node->dest > 0 && !bitset_test(live, node->dest)) {
+                ir_remove(ir, node);
+                removed = true;
+                continue;
+            }
+
+            int n = ir_defs(node, regs);
+            for (int k = 0; k < n; k++) {
+                if (regs[k] > 0)
+                    bitset_clear(live, regs[k]);
+            }
+            n = ir_uses(node, regs);
+            for (int k = 0; k < n; k++) {
+                if (regs[k] > 0)
+                    bitset_set(live, regs[k]);
+            }
+        }
+    }
+
+    destroy_biset(live);
+    free_cfg(cfg);
+    return removed;
+}
+
+void eliminate_dead_code(IR *ir, IRFunction *fn) {
+    int num_regs = ir->next_temp_reg;
+    remove_unreachable(ir, fn);
+
+    Frame f = {0};
+    f.fn = fn;
+    f.num_regs = num_regs;
+    f.def = (IRNode **)calloc(num_regs, sizeof(IRNode *));
+    int *num_defs = (int *)calloc(num_regs, sizeof(int));
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node->dest > 0 && num_defs[node->dest]++ == 0)
+            f.def[node->dest] = node;
+        else if (node->dest > 0)
+            f.def[node->dest] = NULL;
+    }
+    remove_dead_stores(ir, &f);
+    free(num_defs);
+    free(f.def);
+
+    // virtual registers are their own bit, physical ones are not tracked
+    int *table = (int *)malloc((NUM_REGISTERS + num_regs) * sizeof(int));
+    int *local = table + NUM_REGISTERS;
+    for (int reg = -NUM_REGISTERS; reg < num_regs; reg++)
+        local[reg] = reg > 0 ? reg : -1;
+    bool removed = true;
+    while (removed)
+        removed = remove_dead_instructions(ir, fn, local, num_regs);
+    free(table);
+}
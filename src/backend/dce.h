@@ -0,0 +1,33 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Remove the code of a function that has no effect
+ *
+ * Three cleanups, in this order:
+ * 1. **Unreachable blocks**: the instructions of blocks not reachable from
+ *    the entry (e.g. after the jump of a `return`) are removed. The epilogue
+ *    is kept even when no `return` reaches it.
+ * 2. **Dead stores**: a store to a frame slot (relative to `fp`) that is
+ *    overwritten or left unread on every path to the exit is removed, and
+ *    so is a store to a local array (an address computed from `fp`) when no
+ *    local array is read before the exit. Once an address in the frame is
+ *    used other than by a load or store (e.g. a local array passed as
+ *    argument), a `call` and a load through any other address are assumed
+ *    to read the whole frame.
+ * 3. **Dead instructions**: an instruction without side effects (moves,
+ *    constants, arithmetic and loads) whose virtual register is not live
+ *    after it is removed. Block liveness (`cfg_liveness`) is recomputed and
+ *    the sweep repeated until nothing changes, since removing an
+ *    instruction can make the ones computing its operands dead.
+ *
+ * Writes to physical registers are always kept.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function to clean up, not in SSA form
+ */
+void eliminate_dead_code(IR *ir, IRFunction *fn);
+
+#endif // DCE_H
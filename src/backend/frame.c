@@ -0,0 +1,305 @@
+#include "frame.h"
+#include "../utils/ir.h"
+#include "../utils/object_code.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Instructions followed from a call to the epilogue, a jump may enter an empty loop */
+#define SIBLING_WINDOW 64
+
+/**
+ * @struct Frame
+ * @brief Frame setup and teardown of a function, as emitted by `gen_code`
+ */
+typedef struct Frame {
+    IRNode *push;     /**< `addi sp, sp, -8` */
+    IRNode *save_ra;  /**< `sw ra, 4(sp)` */
+    IRNode *save_fp;  /**< `sw fp, 0(sp)` */
+    IRNode *set_fp;   /**< `mv fp, sp` */
+    IRNode *reset_sp; /**< `mv sp, fp` */
+    IRNode *load_ra;  /**< `lw ra, 4(sp)` */
+    IRNode *load_fp;  /**< `lw fp, 0(sp)` */
+    IRNode *pop;      /**< `addi sp, sp, 8` */
+} Frame;
+
+static IRNode *next_code(IRNode *node) {
+    for (node = node->next; node != NULL; node = node->next) {
+        if (node->instruction != COMMENT)
+            return node;
+    }
+    return NULL;
+}
+
+static IRNode *prev_code(IRNode *node) {
+    for (node = node->prev; node != NULL; node = node->prev) {
+        if (node->instruction != COMMENT)
+            return node;
+    }
+    return NULL;
+}
+
+static bool is_sp_adjustment(const IRNode *node, long imm) {
+    return node != NULL && node->instruction == ADD && node->src_kind == CONST_SRC &&
+           node->dest == SP_REGISTER && node->src1 == SP_REGISTER && node->imm == imm;
+}
+
+static bool is_move(const IRNode *node, int dest, int src) {
+    return node != NULL && node->instruction == MOV && node->dest == dest && node->src1 == src;
+}
+
+/**
+ * @brief Check if an instruction is `lw reg, imm(sp)` or `sw reg, imm(sp)`
+ */
+static bool is_sp_access(const IRNode *node, Instruction instruction, int reg, long imm) {
+    if (node == NULL || node->instruction != instruction || node->src1 != SP_REGISTER ||
+        node->imm != imm)
+        return false;
+    return (instruction == LOAD ? node->dest : node->src2) == reg;
+}
+
+/**
+ * @brief Find the frame instructions right after the entry label and
+ *        right before the final `jalr`
+ *
+ * @return false if the function does not have the usual frame
+ */
+static bool find_frame(const IRFunction *fn, Frame *f) {
+    f->push = next_code(fn->entry);
+    if (!is_sp_adjustment(f->push, -8))
+        return false;
+    f->save_ra = next_code(f->push);
+    if (!is_sp_access(f->save_ra, STORE, RA_REGISTER, 4))
+        return false;
+    f->save_fp = next_code(f->save_ra);
+    if (!is_sp_access(f->save_fp, STORE, FP_REGISTER, 0))
+        return false;
+    f->set_fp = next_code(f->save_fp);
+    if (!is_move(f->set_fp, FP_REGISTER, SP_REGISTER))
+        return false;
+
+    f->pop = prev_code(fn->exit);
+    if (!is_sp_adjustment(f->pop, 8))
+        return false;
+    f->load_fp = prev_code(f->pop);
+    if (!is_sp_access(f->load_fp, LOAD, FP_REGISTER, 0))
+        return false;
+    f->load_ra = prev_code(f->load_fp);
+    if (!is_sp_access(f->load_ra, LOAD, RA_REGISTER, 4))
+        return false;
+    f->reset_sp = prev_code(f->load_ra);
+    return is_move(f->reset_sp, SP_REGISTER, FP_REGISTER);
+}
+
+static int phys(const int *map, int reg) {
+    return reg > 0 ? map[reg] : reg;
+}
+
+/**
+ * @brief Check if the function reads or writes `fp` other than to save,
+ *        set and restore it
+ */
+static bool uses_fp(const IRFunction *fn, const Frame *f) {
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node == f->save_fp || node == f->set_fp || node == f->reset_sp ||
+            node == f->load_fp)
+            continue;
+        if (node->dest == FP_REGISTER || node->src1 == FP_REGISTER ||
+            node->src2 == FP_REGISTER)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check if an address in the frame may be handed to a callee, i.e.
+ *        `fp` is read other than as the base of a load or store
+ */
+static bool frame_escapes(const IRFunction *fn, const Frame *f) {
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node == f->set_fp || node == f->reset_sp || node == f->save_fp)
+            continue;
+        bool is_access = node->instruction == LOAD || node->instruction == STORE;
+        if ((node->src1 == FP_REGISTER && !is_access) || node->src2 == FP_REGISTER)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check if a call is the last thing its function does: only moves run
+ *        between it and the epilogue, and they leave its result in `a0`
+ */
+static bool is_sibling_call(const IRFunction *fn, const IRNode *call, const int *map) {
+    bool returns_value = fn->exit->src2 == A0_REGISTER;
+    bool holds[NUM_REGISTERS] = {false};
+    holds[-A0_REGISTER] = true;
+
+    // comments and labels are not counted, the bound only stops a jump loop
+    const IRNode *node = call->next;
+    int steps = 0;
+    while (node != NULL) {
+        switch (node->instruction) {
+        case COMMENT:
+            node = node->next;
+            break;
+        case LABEL:
+            if (node == fn->epilogue)
+                return !returns_value || holds[-A0_REGISTER];
+            node = node->next;
+            break;
+        case JUMP:
+            if (node->target == NULL || ++steps > SIBLING_WINDOW)
+                return false;
+            node = node->target;
+            break;
+        case MOV:
+            if (++steps > SIBLING_WINDOW)
+                return false;
+            holds[-phys(map, node->dest)] = holds[-phys(map, node->src1)];
+            node = node->next;
+            break;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Replace a sibling call with a copy of the epilogue and a jump to the
+ *        callee, which then returns straight to the caller
+ */
+static void jump_to_callee(IR *ir, const IRFunction *fn, IRNode *call) {
+    IRNode *comment = new_ir_node(COMMENT);
+    comment->comment = strdup("tail call: frame teardown, goto callee");
+    ir_insert_before(ir, call, comment);
+    for (IRNode *node = fn->epilogue->next; node != fn->exit; node = node->next) {
+        if (node->instruction == COMMENT)
+            continue;
+        IRNode *copy = new_ir_node(node->instruction);
+        copy->src_kind = node->src_kind;
+        copy->dest = node->dest;
+        copy->src1 = node->src1;
+        copy->src2 = node->src2;
+        copy->imm = node->imm;
+        ir_insert_before(ir, call, copy);
+    }
+    call->instruction = JUMP;
+    call->imm = 0;
+
+    // the moves after the call are not reached anymore
+    while (call->next != NULL && call->next->instruction != LABEL)
+        ir_remove(ir, call->next);
+}
+
+/**
+ * @brief Restore `ra` and `fp` from above the local area and release the
+ *        whole frame with one `sp` adjustment
+ *
+ * `sp` is `fp - size` at the epilogue, so `mv sp, fp` is not needed; the
+ * saved pair is read before `sp` moves past it, as there is no red zone.
+ */
+static void restore_from_sp(IR *ir, Frame *f, int size, bool leaf) {
+    ir_remove(ir, f->reset_sp);
+    f->load_ra->imm = size + 4;
+    f->load_fp->imm = size;
+    f->pop->imm = size + 8;
+    if (leaf)
+        ir_remove(ir, f->load_ra);
+}
+
+/**
+ * @brief Remove or merge the frame instructions a function does not need
+ */
+static void shrink_frame(IR *ir, IRFunction *fn, Frame *f, bool leaf) {
+    if (!uses_fp(fn, f)) {
+        // the local area, if any, is never addressed
+        if (fn->frame != NULL)
+            ir_remove(ir, fn->frame);
+        fn->frame = NULL;
+        fn->frame_size = 0;
+        ir_remove(ir, f->save_fp);
+        ir_remove(ir, f->set_fp);
+        ir_remove(ir, f->reset_sp);
+        ir_remove(ir, f->load_fp);
+        if (leaf) {
+            ir_remove(ir, f->push);
+            ir_remove(ir, f->save_ra);
+            ir_remove(ir, f->load_ra);
+            ir_remove(ir, f->pop);
+            fn->prologue = fn->entry;
+            return;
+        }
+        f->push->imm = -4;
+        f->save_ra->imm = 0;
+        f->load_ra->imm = 0;
+        f->pop->imm = 4;
+        fn->prologue = f->save_ra;
+        return;
+    }
+
+    int size = fn->frame != NULL ? fn->frame_size : 0;
+    // the epilogue releases the frame with `addi sp, sp, 8 + size`
+    if (!ir_fits_immediate(8 + size)) {
+        if (leaf) {
+            ir_remove(ir, f->save_ra);
+            ir_remove(ir, f->load_ra);
+        }
+        return;
+    }
+
+    // one adjustment reserves the saved pair and the local area below it
+    if (fn->frame != NULL) {
+        f->push->imm = -(8 + size);
+        f->save_ra->imm = size + 4;
+        f->save_fp->imm = size;
+        f->set_fp->instruction = ADD;
+        f->set_fp->src_kind = CONST_SRC;
+        f->set_fp->imm = size;
+        if (fn->prologue == fn->frame)
+            fn->prologue = f->set_fp;
+        ir_remove(ir, fn->frame);
+        fn->frame = NULL;
+    }
+    if (leaf)
+        ir_remove(ir, f->save_ra);
+    restore_from_sp(ir, f, size, leaf);
+}
+
+static void layout_frame(IR *ir, IRFunction *fn, const int *map) {
+    Frame f;
+    if (!find_frame(fn, &f))
+        return;
+
+    // a function whose calls are all sibling calls is a leaf as well
+    int capacity = 4, num_siblings = 0;
+    IRNode **siblings = (IRNode **)malloc(capacity * sizeof(IRNode *));
+    bool escapes = frame_escapes(fn, &f), leaf = true;
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node->instruction != CALL)
+            continue;
+        // the arguments pushed on the stack are popped after the call
+        IRNode *next = next_code(node);
+        bool pops = next != NULL && next->instruction == ADD && next->dest == SP_REGISTER;
+        if (escapes || pops || !is_sibling_call(fn, node, map)) {
+            leaf = false;
+            continue;
+        }
+        if (num_siblings == capacity) {
+            capacity *= 2;
+            siblings = (IRNode **)realloc(siblings, capacity * sizeof(IRNode *));
+        }
+        siblings[num_siblings++] = node;
+    }
+
+    shrink_frame(ir, fn, &f, leaf);
+    for (int i = 0; i < num_siblings; i++)
+        jump_to_callee(ir, fn, siblings[i]);
+    free(siblings);
+}
+
+void layout_frames(IR *ir, const int *map) {
+    for (IRFunction *fn = ir->functions; fn != NULL; fn = fn->next)
+        layout_frame(ir, fn, map);
+}
@@ -0,0 +1,38 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Shrink the prologue and epilogue of each function to what its
+ *        allocated code needs
+ *
+ * Code generation always saves `ra` and `fp`, points `fp` at the saved
+ * pair and reserves the local area with a second `sp` adjustment. Once
+ * registers are allocated (spill slots and callee-saved registers
+ * included) the frame is final, and:
+ * - a leaf function (no `call`) does not save or restore `ra`;
+ * - a function that never addresses through `fp` neither saves nor sets
+ *   it, and drops its local area, which nothing can read;
+ * - otherwise both `sp` adjustments become one, `fp` is set from the new
+ *   `sp`, and the epilogue reloads `ra` and `fp` from above the local area
+ *   before releasing the whole frame with one `addi sp`, as long as the
+ *   offsets fit in 12 bits.
+ *
+ * A call followed only by moves that leave its result in `a0` is a sibling
+ * call: when all its arguments are in registers and no address in the frame
+ * is taken, it becomes a copy of the epilogue and a `j` to the callee, which
+ * returns straight to the caller. Such calls do not keep a function from
+ * being a leaf.
+ *
+ * A leaf function that never uses `fp` is left without any frame. The
+ * layout seen from `fp` is unchanged: saved `fp` at `0(fp)`, `ra` at
+ * `4(fp)` and the arguments passed on the stack from `8(fp)` on.
+ *
+ * @param ir Pointer to IR structure, after register allocation
+ * @param map Physical register of each virtual register, as returned by
+ *            `allocate_registers`
+ */
+void layout_frames(IR *ir, const int *map);
+
+#endif // FRAME_H
@@ -0,0 +1,321 @@
+#include "gvn.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * @struct Expression
+ * @brief Value computed by a pure instruction, with its operands already
+ *        replaced by the registers holding the same value
+ */
+typedef struct Expression {
+    Instruction instruction;
+    SourceKind src_kind;
+    int src1, src2;
+    long imm;
+    int generation; /**< memory generation of a load, 0 otherwise */
+} Expression;
+
+/**
+ * @struct Entry
+ * @brief Expression available in the current block, chained by bucket
+ */
+typedef struct Entry {
+    Expression key;
+    int reg;  /**< register holding the value */
+    int next; /**< next entry of the bucket, -1 at the end */
+} Entry;
+
+/**
+ * @struct Numbering
+ * @brief State of the walk over the dominator tree
+ *
+ * Both the expression table and the register replacements are scoped: the
+ * entries pushed by a block are popped once its dominator subtree is done,
+ * so only the values computed by dominating instructions are visible.
+ */
+typedef struct Numbering {
+    int num_regs;
+    int *num_defs;    /**< register ID -> number of definitions */
+    int *replace;     /**< register ID -> register holding the same value, 0 while the
+                           definition does not dominate the current block */
+    int *undo;        /**< pairs (register, previous replacement), in order */
+    int undo_size;
+    int undo_capacity;
+
+    Entry *entries;   /**< expressions available, in order */
+    int num_entries;
+    int capacity;
+    int *buckets;     /**< hash -> last entry of the bucket, -1 if empty */
+    int num_buckets;  /**< power of two */
+
+    int generation;      /**< memory generation at the current instruction */
+    int last_generation; /**< last memory generation handed out */
+} Numbering;
+
+/**
+ * @brief Register holding the value of an operand
+ */
+static int lookup_reg(const Numbering *nb, int reg) {
+    return reg > 0 && reg < nb->num_regs && nb->replace[reg] != 0 ? nb->replace[reg] : reg;
+}
+
+static void set_replace(Numbering *nb, int reg, int by) {
+    if (nb->undo_size + 2 > nb->undo_capacity) {
+        nb->undo_capacity *= 2;
+        nb->undo = (int *)realloc(nb->undo, nb->undo_capacity * sizeof(int));
+    }
+    nb->undo[nb->undo_size++] = reg;
+    nb->undo[nb->undo_size++] = nb->replace[reg];
+    nb->replace[reg] = by;
+}
+
+static bool is_single_def(const Numbering *nb, int reg) {
+    return reg > 0 && reg < nb->num_regs && nb->num_defs[reg] == 1;
+}
+
+/**
+ * @brief Check if a register keeps its value from its definition on
+ *
+ * A virtual register with a single definition qualifies once that
+ * definition dominates the current instruction: a variable read before
+ * being assigned keeps one definition, which may run again later. `x0`,
+ * `fp` and `gp` are never written in the function body.
+ */
+static bool is_stable(const Numbering *nb, int reg) {
+    if (reg == X0_REGISTER || reg == FP_REGISTER || reg == GP_REGISTER)
+        return true;
+    return is_single_def(nb, reg) && nb->replace[reg] != 0;
+}
+
+static bool is_expression(const IRNode *node) {
+    // copies are propagated instead, and `auipc` depends on its address
+    return ir_is_pure(node) && node->instruction != MOV && node->instruction != AUIPC;
+}
+
+/**
+ * @brief Build the expression computed by a pure instruction
+ *
+ * @return false if an operand may change, so the value cannot be reused
+ */
+static bool make_expression(const Numbering *nb, const IRNode *node, Expression *e) {
+    e->instruction = node->instruction;
+    e->src_kind = node->src_kind;
+    e->src1 = 0;
+    e->src2 = 0;
+    e->imm = node->imm;
+    e->generation = node->instruction == LOAD ? nb->generation : 0;
+
+    if (node->instruction == LI || node->instruction == LUI)
+        return true;
+    if (!is_stable(nb, node->src1))
+        return false;
+    e->src1 = node->src1;
+    if (node->instruction == LOAD || node->src_kind == CONST_SRC)
+        return true;
+    if (!is_stable(nb, node->src2))
+        return false;
+    e->src2 = node->src2;
+    e->imm = 0;
+
+    // `a + b` and `b + a` are the same value
+    if ((e->instruction == ADD || e->instruction == MUL) && e->src1 > e->src2) {
+        e->src1 = node->src2;
+        e->src2 = node->src1;
+    }
+    return true;
+}
+
+static unsigned hash_expression(const Expression *e) {
+    unsigned h = (unsigned)e->instruction;
+    h = h * 31 + (unsigned)e->src_kind;
+    h = h * 31 + (unsigned)e->src1;
+    h = h * 31 + (unsigned)e->src2;
+    h = h * 31 + (unsigned)e->imm;
+    h = h * 31 + (unsigned)e->generation;
+    return h ^ (h >> 16);
+}
+
+static bool same_expression(const Expression *a, const Expression *b) {
+    return a->instruction == b->instruction && a->src_kind == b->src_kind && a->src1 == b->src1 &&
+           a->src2 == b->src2 && a->imm == b->imm && a->generation == b->generation;
+}
+
+/**
+ * @brief Register already holding an expression
+ *
+ * @return The register, or 0 if the expression is not available
+ */
+static int find_expression(const Numbering *nb, const Expression *e) {
+    int bucket = (int)(hash_expression(e) & (unsigned)(nb->num_buckets - 1));
+    for (int i = nb->buckets[bucket]; i >= 0; i = nb->entries[i].next) {
+        if (same_expression(&nb->entries[i].key, e))
+            return nb->entries[i].reg;
+    }
+    return 0;
+}
+
+static void add_expression(Numbering *nb, const Expression *e, int reg) {
+    if (nb->num_entries == nb->capacity) {
+        nb->capacity *= 2;
+        nb->entries = (Entry *)realloc(nb->entries, nb->capacity * sizeof(Entry));
+    }
+    int bucket = (int)(hash_expression(e) & (unsigned)(nb->num_buckets - 1));
+    Entry *entry = &nb->entries[nb->num_entries];
+    entry->key = *e;
+    entry->reg = reg;
+    entry->next = nb->buckets[bucket];
+    nb->buckets[bucket] = nb->num_entries++;
+}
+
+/**
+ * @brief Forget the expressions added after the first `num_entries`
+ */
+static void pop_expressions(Numbering *nb, int num_entries) {
+    while (nb->num_entries > num_entries) {
+        Entry *entry = &nb->entries[--nb->num_entries];
+        int bucket = (int)(hash_expression(&entry->key) & (unsigned)(nb->num_buckets - 1));
+        nb->buckets[bucket] = entry->next;
+    }
+}
+
+/**
+ * @brief Record that a load from the address just stored to reads the
+ *        stored value
+ */
+static void forward_store(Numbering *nb, const IRNode *store) {
+    if (store->src2 <= 0 || !is_stable(nb, store->src2))
+        return;
+
+    IRNode load = {0};
+    load.instruction = LOAD;
+    load.src_kind = REG_SRC;
+    load.src1 = store->src1;
+    load.imm = store->imm;
+    Expression e;
+    if (make_expression(nb, &load, &e))
+        add_expression(nb, &e, store->src2);
+}
+
+/**
+ * @brief Number the values of a block and of the blocks it dominates
+ *
+ * @param generation Memory generation at the end of the parent block
+ */
+static void number_block(Numbering *nb, BasicBlock *b, int generation) {
+    int num_entries = nb->num_entries, undo_size = nb->undo_size;
+
+    // another predecessor may have stored to memory
+    nb->generation = b->num_preds == 1 ? generation : ++nb->last_generation;
+
+    for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+        if (node->instruction == PHI) {
+            if (is_single_def(nb, node->dest))
+                set_replace(nb, node->dest, node->dest);
+            continue;
+        }
+        node->src1 = lookup_reg(nb, node->src1);
+        node->src2 = lookup_reg(nb, node->src2);
+
+        if (node->instruction == STORE) {
+            nb->generation = ++nb->last_generation;
+            forward_store(nb, node);
+            continue;
+        }
+        if (node->instruction == CALL) {
+            nb->generation = ++nb->last_generation;
+            continue;
+        }
+        if (!is_single_def(nb, node->dest))
+            continue;
+
+        // copies of virtual registers and of `gp` are read through the original
+        if (node->instruction == MOV && (node->src1 > 0 || node->src1 == GP_REGISTER) &&
+            is_stable(nb, node->src1)) {
+            set_replace(nb, node->dest, node->src1);
+            continue;
+        }
+
+        Expression e;
+        int reg = 0;
+        if (is_expression(node) && make_expression(nb, node, &e)) {
+            reg = find_expression(nb, &e);
+            if (reg == 0)
+                add_expression(nb, &e, node->dest);
+        }
+        if (reg == 0) {
+            set_replace(nb, node->dest, node->dest);
+            continue;
+        }
+
+        // reads not dominated by this instruction still see its register
+        node->instruction = MOV;
+        node->src_kind = REG_SRC;
+        node->src1 = reg;
+        node->src2 = 0;
+        node->imm = 0;
+        set_replace(nb, node->dest, reg);
+    }
+
+    // the phis of the successors read their operand at the end of this block
+    for (int k = 0; k < b->num_succs; k++) {
+        BasicBlock *s = b->succ[k];
+        for (int j = 0; j < s->num_preds; j++) {
+            if (s->preds[j] != b)
+                continue;
+            for (IRNode *node = s->first; node != s->last->next; node = node->next) {
+                if (node->instruction == PHI)
+                    node->args[j] = lookup_reg(nb, node->args[j]);
+                else if (node->instruction != LABEL && node->instruction != COMMENT)
+                    break;
+            }
+        }
+    }
+
+    int end = nb->generation;
+    for (int i = 0; i < b->num_children; i++)
+        number_block(nb, b->children[i], end);
+
+    pop_expressions(nb, num_entries);
+    while (nb->undo_size > undo_size) {
+        nb->undo_size -= 2;
+        nb->replace[nb->undo[nb->undo_size]] = nb->undo[nb->undo_size + 1];
+    }
+}
+
+void number_values(IR *ir, IRFunction *fn) {
+    Numbering nb = {0};
+    nb.num_regs = ir->next_temp_reg;
+    nb.num_defs = (int *)calloc(nb.num_regs, sizeof(int));
+    nb.replace = (int *)calloc(nb.num_regs, sizeof(int));
+
+    int size = 0;
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        if (node->dest > 0)
+            nb.num_defs[node->dest]++;
+        size++;
+    }
+
+    nb.num_buckets = 16;
+    while (nb.num_buckets < size)
+        nb.num_buckets *= 2;
+    nb.buckets = (int *)malloc(nb.num_buckets * sizeof(int));
+    for (int i = 0; i < nb.num_buckets; i++)
+        nb.buckets[i] = -1;
+    nb.capacity = 64;
+    nb.entries = (Entry *)malloc(nb.capacity * sizeof(Entry));
+    nb.undo_capacity = 64;
+    nb.undo = (int *)malloc(nb.undo_capacity * sizeof(int));
+
+    CFG *cfg = build_cfg(fn);
+    cfg_dominators(cfg);
+    number_block(&nb, cfg->rpo[0], 0);
+    free_cfg(cfg);
+
+    free(nb.undo);
+    free(nb.entries);
+    free(nb.buckets);
+    free(nb.replace);
+    free(nb.num_defs);
+}
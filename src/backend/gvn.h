@@ -0,0 +1,32 @@
+#ifndef GVN_H
+#define GVN_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Dominator-based value numbering over a function in SSA form
+ *
+ * Walks the dominator tree in preorder with a scoped hash table of the
+ * expressions computed by the dominating instructions. An instruction
+ * computing an expression already in the table (same operation, operands
+ * and immediate; the operands of `add` and `mul` in either order) is
+ * redundant: it becomes a move from the register holding the value, and the
+ * reads it dominates use that register directly. Moves between virtual
+ * registers are propagated the same way.
+ *
+ * Loads take part too, as long as memory is unchanged since the dominating
+ * one: a `store` or a `call` starts a new memory generation, and so does a
+ * block with several predecessors, since another path may have stored in
+ * between. A stored value is also reused by a later load of the same
+ * address.
+ *
+ * Reads not dominated by the redundant instruction (a variable read before
+ * being assigned on some path) keep its register, so the move is left for
+ * `eliminate_dead_code` to remove once it is unused.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function in SSA form (see ssa.h)
+ */
+void number_values(IR *ir, IRFunction *fn);
+
+#endif // GVN_H
@@ -0,0 +1,490 @@
+#include "induction.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include "../utils/object_code.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct Induction
+ * @brief Register holding `base + scale * iv + offset` in every iteration
+ */
+typedef struct Induction {
+    int iv;      /**< phi of the basic induction variable, 0 if not an induction */
+    int scale;   /**< power of two */
+    int base;    /**< invariant register, 0 if none */
+    long offset;
+} Induction;
+
+/**
+ * @struct Pointer
+ * @brief Register replacing the inductions sharing a variable, scale and base
+ */
+typedef struct Pointer {
+    int iv, scale, base;
+    int reg;          /**< phi of the pointer in the header */
+    bool dereferenced; /**< a load or store reads it on every iteration */
+} Pointer;
+
+/**
+ * @struct Loop
+ * @brief Natural loop being processed, and the registers of its function
+ */
+typedef struct Loop {
+    IR *ir;
+    CFG *cfg;
+    BasicBlock *header;
+    bool *body;        /**< block ID -> in the loop */
+    BasicBlock *entry; /**< only block entering the loop */
+    BasicBlock *latch; /**< only block jumping back to the header */
+    int entry_arg;     /**< index of `entry` in the phi operands */
+    int latch_arg;     /**< index of `latch` in the phi operands */
+    IRNode *preheader; /**< node the setup code goes before, see `cfg_loop_entry` */
+
+    int num_regs;
+    int *num_defs;     /**< register ID -> number of definitions */
+    IRNode **def;      /**< register ID -> only definition, NULL if none or several */
+    Induction *ind;    /**< register ID -> induction it holds */
+
+    Pointer *pointers;
+    int num_pointers;
+    int capacity;
+} Loop;
+
+/**
+ * @brief Smallest `k` with `2^k >= c`
+ */
+static int log2_ceil(int c) {
+    int k = 0;
+    while ((1 << k) < c)
+        k++;
+    return k;
+}
+
+static bool in_loop(const Loop *l, const IRNode *node) {
+    return l->body[node->block->id];
+}
+
+/**
+ * @brief Check if a register is available, with the same value, in the
+ *        preheader and the whole loop
+ */
+static bool is_invariant(const Loop *l, int reg) {
+    if (reg == X0_REGISTER || reg == FP_REGISTER || reg == GP_REGISTER)
+        return true;
+    if (reg <= 0 || reg >= l->num_regs || l->def[reg] == NULL)
+        return false;
+    BasicBlock *b = l->def[reg]->block;
+    return !l->body[b->id] && b->rpo >= 0 && cfg_dominates(b, l->entry);
+}
+
+static Induction induction_of(const Loop *l, int reg) {
+    Induction none = {0};
+    return reg > 0 && reg < l->num_regs ? l->ind[reg] : none;
+}
+
+/**
+ * @brief Update of a basic induction variable along the back edge
+ *
+ * @return The `addi` giving the next value, NULL if the phi is not one
+ */
+static IRNode *basic_update(const Loop *l, const IRNode *phi) {
+    int next = phi->args[l->latch_arg];
+    if (next <= 0 || next >= l->num_regs || l->def[next] == NULL)
+        return NULL;
+    IRNode *update = l->def[next];
+    if (update->instruction != ADD || update->src_kind != CONST_SRC ||
+        update->src1 != phi->dest || update->imm == 0 || !in_loop(l, update))
+        return NULL;
+    return update;
+}
+
+/**
+ * @brief Find the inductions of the loop: the basic variables in the
+ *        header, then the registers derived from them
+ */
+static void find_inductions(Loop *l) {
+    for (IRNode *node = l->header->first; node != l->header->last->next; node = node->next) {
+        if (node->instruction == PHI && l->num_defs[node->dest] == 1 && basic_update(l, node)) {
+            Induction basic = {node->dest, 1, 0, 0};
+            l->ind[node->dest] = basic;
+        }
+    }
+
+    // definitions come before their uses in reverse postorder, phis aside
+    for (int i = 0; i < l->cfg->num_reachable; i++) {
+        BasicBlock *b = l->cfg->rpo[i];
+        if (!l->body[b->id])
+            continue;
+        for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+            int dest = node->dest;
+            if (node->instruction == PHI || dest <= 0 || l->num_defs[dest] != 1)
+                continue;
+
+            Induction x = induction_of(l, node->src1);
+            if (node->src_kind == REG_SRC && node->instruction == ADD && x.iv == 0) {
+                // `base + i` as well as `i + base`
+                x = induction_of(l, node->src2);
+                if (x.iv != 0 && x.base == 0 && is_invariant(l, node->src1)) {
+                    x.base = node->src1;
+                    l->ind[dest] = x;
+                }
+                continue;
+            }
+            if (x.iv == 0)
+                continue;
+
+            if (node->instruction == MOV) {
+                l->ind[dest] = x;
+            } else if (node->instruction == ADD && node->src_kind == CONST_SRC) {
+                x.offset += node->imm;
+                l->ind[dest] = x;
+            } else if (node->instruction == ADD && x.base == 0 && is_invariant(l, node->src2) &&
+                       induction_of(l, node->src2).iv == 0) {
+                x.base = node->src2;
+                l->ind[dest] = x;
+            } else if (node->instruction == SLL && node->src_kind == CONST_SRC && x.base == 0 &&
+                       node->imm >= 0 && node->imm < 11 && x.scale << node->imm <= UPPER_LIMIT) {
+                x.scale <<= node->imm;
+                x.offset *= 1L << node->imm;
+                l->ind[dest] = x;
+            }
+        }
+    }
+}
+
+static IRNode *insert_op(Loop *l, IRNode *pos, Instruction instruction, int src1, int src2,
+                         long imm) {
+    IRNode *node = new_ir_node(instruction);
+    node->src_kind = src2 != 0 || instruction == MOV ? REG_SRC : CONST_SRC;
+    node->dest = register_new_temp(l->ir);
+    node->src1 = src1;
+    node->src2 = src2;
+    node->imm = imm;
+    ir_insert_before(l->ir, pos, node);
+    return node;
+}
+
+/**
+ * @brief Compute `base + (reg << log2(scale))` at the end of the preheader
+ *
+ * A constant `reg` is folded into an `addi`.
+ */
+static int insert_address(Loop *l, int base, int reg, int scale) {
+    const IRNode *def = reg > 0 && reg < l->num_regs ? l->def[reg] : NULL;
+    if (reg == X0_REGISTER || (def != NULL && def->instruction == LI && def->imm == 0))
+        return insert_op(l, l->preheader, MOV, base, 0, 0)->dest;
+    if (def != NULL && def->instruction == LI && ir_fits_immediate(def->imm * scale))
+        return insert_op(l, l->preheader, ADD, base, 0, def->imm * scale)->dest;
+
+    int offset = reg;
+    if (scale > 1)
+        offset = insert_op(l, l->preheader, SLL, reg, 0, log2_ceil(scale))->dest;
+    return insert_op(l, l->preheader, ADD, base, offset, 0)->dest;
+}
+
+/**
+ * @brief Pointer standing for an induction with a base, created on first use
+ *
+ * @return The pointer, NULL if its step does not fit in an immediate
+ */
+static Pointer *pointer_for(Loop *l, Induction x) {
+    for (int i = 0; i < l->num_pointers; i++) {
+        Pointer *p = &l->pointers[i];
+        if (p->iv == x.iv && p->scale == x.scale && p->base == x.base)
+            return p;
+    }
+
+    IRNode *phi = l->def[x.iv];
+    IRNode *update = basic_update(l, phi);
+    long step = update->imm * x.scale;
+    if (!ir_fits_immediate(step))
+        return NULL;
+
+    int init = insert_address(l, x.base, phi->args[l->entry_arg], x.scale);
+
+    // the new phi goes after the ones of the header
+    IRNode *last = phi;
+    while (last->next->instruction == PHI)
+        last = last->next;
+    IRNode *pphi = new_ir_node(PHI);
+    pphi->src_kind = REG_SRC;
+    pphi->dest = register_new_temp(l->ir);
+    pphi->imm = pphi->dest;
+    pphi->num_args = phi->num_args;
+    pphi->args = (int *)malloc(phi->num_args * sizeof(int));
+    ir_insert_after(l->ir, last, pphi);
+
+    // bumped at the end of the latch, so the old value is no longer read
+    IRNode *bump = new_ir_node(ADD);
+    bump->src_kind = CONST_SRC;
+    bump->dest = register_new_temp(l->ir);
+    bump->src1 = pphi->dest;
+    bump->imm = step;
+    IRNode *term = block_terminator(l->latch);
+    if (term != NULL && term->target != NULL)
+        ir_insert_before(l->ir, term, bump);
+    else
+        ir_insert_after(l->ir, l->latch->last, bump);
+    pphi->args[l->entry_arg] = init;
+    pphi->args[l->latch_arg] = bump->dest;
+
+    if (l->num_pointers == l->capacity) {
+        l->capacity = l->capacity == 0 ? 4 : 2 * l->capacity;
+        l->pointers = (Pointer *)realloc(l->pointers, l->capacity * sizeof(Pointer));
+    }
+    Pointer *p = &l->pointers[l->num_pointers++];
+    p->iv = x.iv;
+    p->scale = x.scale;
+    p->base = x.base;
+    p->reg = pphi->dest;
+    p->dereferenced = false;
+    return p;
+}
+
+/**
+ * @brief Rewrite the addresses of the loop from the pointers
+ *
+ * The loads and stores through an address use the pointer with the
+ * constant part as offset; the address itself becomes a copy (or an
+ * `addi`) of the pointer, left to `eliminate_dead_code` if no longer read.
+ */
+static void reduce_addresses(Loop *l) {
+    int num_regs = l->num_regs;
+    for (int reg = 1; reg < num_regs; reg++) {
+        Induction x = l->ind[reg];
+        if (x.iv == 0 || x.base == 0 || !in_loop(l, l->def[reg]) || !ir_fits_immediate(x.offset))
+            continue;
+        Pointer *p = pointer_for(l, x);
+        if (p == NULL)
+            continue;
+
+        for (int i = 0; i < l->cfg->num_reachable; i++) {
+            BasicBlock *b = l->cfg->rpo[i];
+            if (!l->body[b->id])
+                continue;
+            for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+                if ((node->instruction != LOAD && node->instruction != STORE) ||
+                    node->src1 != reg || !ir_fits_immediate(node->imm + x.offset))
+                    continue;
+                node->src1 = p->reg;
+                node->imm += x.offset;
+                if (cfg_dominates(b, l->latch))
+                    p->dereferenced = true;
+            }
+        }
+
+        IRNode *def = l->def[reg];
+        def->instruction = x.offset == 0 ? MOV : ADD;
+        def->src_kind = x.offset == 0 ? REG_SRC : CONST_SRC;
+        def->src1 = p->reg;
+        def->src2 = 0;
+        def->imm = x.offset;
+    }
+}
+
+/**
+ * @brief Count the reads of every virtual register of the function
+ */
+static void count_uses(const IRFunction *fn, int *uses, int num_regs) {
+    memset(uses, 0, num_regs * sizeof(int));
+    int regs[NUM_REGISTERS];
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        int n = ir_uses(node, regs);
+        for (int k = 0; k < n; k++) {
+            if (regs[k] > 0 && regs[k] < num_regs)
+                uses[regs[k]]++;
+        }
+        for (int k = 0; k < node->num_args; k++) {
+            if (node->args[k] > 0 && node->args[k] < num_regs)
+                uses[node->args[k]]++;
+        }
+    }
+}
+
+/**
+ * @brief Remove the pure instructions of the loop whose result is unread,
+ *        and then the ones computing their operands
+ */
+static void remove_unused(Loop *l, const int *uses_in) {
+    int *uses = (int *)malloc(l->num_regs * sizeof(int));
+    memcpy(uses, uses_in, l->num_regs * sizeof(int));
+    bool removed = true;
+    while (removed) {
+        removed = false;
+        for (int reg = 1; reg < l->num_regs; reg++) {
+            IRNode *def = l->def[reg];
+            if (def == NULL || uses[reg] > 0 || !in_loop(l, def) ||
+                (!ir_is_pure(def) && def->instruction != PHI))
+                continue;
+            int regs[NUM_REGISTERS];
+            int n = ir_uses(def, regs);
+            for (int k = 0; k < n; k++) {
+                if (regs[k] > 0 && regs[k] < l->num_regs)
+                    uses[regs[k]]--;
+            }
+            for (int k = 0; k < def->num_args; k++) {
+                if (def->args[k] > 0 && def->args[k] < l->num_regs)
+                    uses[def->args[k]]--;
+            }
+            ir_remove(l->ir, def);
+            l->def[reg] = NULL;
+            removed = true;
+        }
+    }
+    free(uses);
+}
+
+/**
+ * @brief Check if the loop is only left by the branch ending its header
+ */
+static bool single_exit(const Loop *l, const IRNode *term) {
+    for (int i = 0; i < l->cfg->num_reachable; i++) {
+        BasicBlock *b = l->cfg->rpo[i];
+        if (!l->body[b->id])
+            continue;
+        for (int k = 0; k < b->num_succs; k++) {
+            if (!l->body[b->succ[k]->id] && (b != l->header || b->succ[k] != term->target->block))
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check if a register is a constant whose address offset at the given
+ *        scale fits in an immediate
+ */
+static bool is_small_constant(const Loop *l, int reg, int scale) {
+    if (reg == X0_REGISTER)
+        return true;
+    const IRNode *def = reg > 0 && reg < l->num_regs ? l->def[reg] : NULL;
+    return def != NULL && def->instruction == LI && ir_fits_immediate(def->imm * scale);
+}
+
+/**
+ * @brief Compare a pointer against the address of the bound instead of
+ *        the induction variable against the bound, then drop the variable
+ *
+ * The start value and the bound must be small constants: the addresses
+ * computed from any other `int` may wrap around, even when the loop does
+ * not run at all. The variable is kept otherwise, only its address
+ * arithmetic is gone.
+ */
+static void replace_test(Loop *l, int *uses) {
+    IRNode *term = block_terminator(l->header);
+    if (term == NULL || term->target == NULL || l->body[term->target->block->id] ||
+        !single_exit(l, term))
+        return;
+
+    int iv = term->src1;
+    Induction x = induction_of(l, iv);
+    if (x.iv != iv || !is_invariant(l, term->src2))
+        return;
+    IRNode *phi = l->def[iv];
+    IRNode *update = basic_update(l, phi);
+    bool up = term->instruction == BGE || term->instruction == BGT;
+    bool down = term->instruction == BLE || term->instruction == BLT;
+    if (!(up && update->imm > 0) && !(down && update->imm < 0))
+        return;
+    // the variable must only feed the test and its own update
+    if (uses[iv] != 2 || uses[update->dest] != 1)
+        return;
+
+    Pointer *p = NULL;
+    for (int i = 0; i < l->num_pointers && p == NULL; i++) {
+        if (l->pointers[i].iv == iv && l->pointers[i].dereferenced)
+            p = &l->pointers[i];
+    }
+    if (p == NULL || !is_small_constant(l, phi->args[l->entry_arg], p->scale) ||
+        !is_small_constant(l, term->src2, p->scale))
+        return;
+
+    // the scale is positive, so the order of the values is kept
+    term->src2 = insert_address(l, p->base, term->src2, p->scale);
+    term->src1 = p->reg;
+    ir_remove(l->ir, update);
+    ir_remove(l->ir, phi);
+}
+
+/**
+ * @brief Strength-reduce the inductions of the natural loop of a header
+ */
+static void reduce_loop(Loop *l) {
+    BasicBlock *h = l->header;
+    l->preheader = cfg_loop_entry(h, l->body);
+    if (l->preheader == NULL)
+        return;
+
+    l->entry = l->latch = NULL;
+    for (int j = 0; j < h->num_preds; j++) {
+        BasicBlock *p = h->preds[j];
+        if (p->rpo < 0)
+            continue;
+        if (l->body[p->id]) {
+            if (l->latch != NULL)
+                return;
+            l->latch = p;
+            l->latch_arg = j;
+        } else {
+            l->entry = p;
+            l->entry_arg = j;
+        }
+    }
+    // the phis would need an operand per edge
+    if (l->latch == NULL || h->num_preds != 2)
+        return;
+
+    memset(l->ind, 0, l->num_regs * sizeof(Induction));
+    l->num_pointers = 0;
+    find_inductions(l);
+    reduce_addresses(l);
+    if (l->num_pointers == 0)
+        return;
+
+    int num_regs = l->ir->next_temp_reg;
+    int *uses = (int *)malloc(num_regs * sizeof(int));
+    count_uses(l->cfg->fn, uses, num_regs);
+    remove_unused(l, uses);
+    count_uses(l->cfg->fn, uses, num_regs);
+    replace_test(l, uses);
+    free(uses);
+}
+
+/**
+ * @brief Number the registers of the function again, then reduce the loop
+ *        of a header
+ */
+static void visit_loop(CFG *cfg, BasicBlock *header, bool *body, void *data) {
+    Loop *l = (Loop *)data;
+    IRFunction *fn = cfg->fn;
+
+    // registers created for the previous loop are numbered too
+    l->num_regs = l->ir->next_temp_reg;
+    l->num_defs = (int *)calloc(l->num_regs, sizeof(int));
+    l->def = (IRNode **)calloc(l->num_regs, sizeof(IRNode *));
+    l->ind = (Induction *)malloc(l->num_regs * sizeof(Induction));
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node->dest > 0 && l->num_defs[node->dest]++ == 0)
+            l->def[node->dest] = node;
+        else if (node->dest > 0)
+            l->def[node->dest] = NULL;
+    }
+
+    l->cfg = cfg;
+    l->header = header;
+    l->body = body;
+    reduce_loop(l);
+
+    free(l->ind);
+    free(l->def);
+    free(l->num_defs);
+}
+
+void reduce_induction_variables(IR *ir, IRFunction *fn) {
+    Loop l = {0};
+    l.ir = ir;
+    cfg_for_each_loop(fn, visit_loop, &l);
+    free(l.pointers);
+}
@@ -0,0 +1,31 @@
+#ifndef INDUCTION_H
+#define INDUCTION_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Strength reduction of array addresses indexed by an induction
+ *        variable, in a function in SSA form
+ *
+ * A basic induction variable is a phi of a loop header (see
+ * `cfg_natural_loop`) whose value along the back edge is itself plus a
+ * constant step `c` (`i = i + c`). The registers derived from it by adding
+ * constants, shifting left and adding one invariant register (e.g. the
+ * address `base + (i << 2)` of `a[i]`) are rewritten from a new pointer
+ * `p = base + (i << 2)`, set before the loop and bumped by `4 * c` at the
+ * end of the iteration. The constant part of the address goes into the
+ * offset of the loads and stores reading it, so `a[i + 1]` reads `4(p)`.
+ *
+ * When the loop exit compares the induction variable against an invariant
+ * bound and nothing else reads the variable, the comparison is made on the
+ * pointer instead (linear-function test replacement) and the variable is
+ * removed. This needs the loop to only leave through that comparison and
+ * to access memory through the pointer on every iteration, so the pointer
+ * stays within an array and its comparison cannot overflow.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function in SSA form (see ssa.h)
+ */
+void reduce_induction_variables(IR *ir, IRFunction *fn);
+
+#endif // INDUCTION_H
@@ -0,0 +1,189 @@
+#include "licm.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct Loop
+ * @brief Natural loop being processed, and the registers of its function
+ */
+typedef struct Loop {
+    IR *ir;
+    CFG *cfg;
+    BasicBlock *header;
+    bool *body;           /**< block ID -> in the loop */
+    bool writes_memory;   /**< the loop has a `store` or a `call` */
+
+    int num_regs;
+    int *num_defs;        /**< register ID -> number of definitions */
+    IRNode **def;         /**< register ID -> only definition, NULL if none or several */
+    bool *invariant;      /**< register ID -> defined by an instruction being moved */
+} Loop;
+
+/**
+ * @brief Check if a register holds the same value on every iteration
+ */
+static bool is_invariant_reg(const Loop *l, int reg) {
+    if (reg == X0_REGISTER || reg == FP_REGISTER || reg == GP_REGISTER)
+        return true;
+    if (reg < 0 || reg >= l->num_regs)
+        return false;
+    // a register never written is never changed either
+    if (l->num_defs[reg] == 0)
+        return true;
+    if (l->def[reg] == NULL)
+        return false;
+    return !l->body[l->def[reg]->block->id] || l->invariant[reg];
+}
+
+/**
+ * @brief Check if a store in the loop writes a slot relative to `fp`
+ */
+static bool stores_to_slot(const Loop *l, long offset) {
+    for (int i = 0; i < l->cfg->num_reachable; i++) {
+        BasicBlock *b = l->cfg->rpo[i];
+        if (!l->body[b->id])
+            continue;
+        for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+            if (node->instruction == STORE && node->src1 == FP_REGISTER && node->imm == offset)
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check if a block runs on every iteration that leaves the loop
+ */
+static bool dominates_exits(const Loop *l, const BasicBlock *b) {
+    for (int i = 0; i < l->cfg->num_reachable; i++) {
+        BasicBlock *e = l->cfg->rpo[i];
+        if (!l->body[e->id])
+            continue;
+        for (int k = 0; k < e->num_succs; k++) {
+            if (!l->body[e->succ[k]->id] && !cfg_dominates(b, e))
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check if a load can run once before the loop instead of in it
+ */
+static bool is_invariant_load(const Loop *l, const IRNode *node) {
+    int base = node->src1;
+    // incoming arguments are only written by the function itself
+    if (base == FP_REGISTER && node->imm >= 0 && !stores_to_slot(l, node->imm))
+        return true;
+    if (l->writes_memory)
+        return false;
+
+    // the load may not have run at all, so its address must be valid anyway
+    if (base == FP_REGISTER || base == GP_REGISTER || dominates_exits(l, node->block))
+        return true;
+    const IRNode *def = base > 0 && base < l->num_regs ? l->def[base] : NULL;
+    return def != NULL &&
+           (def->instruction == LI || def->instruction == LUI || def->instruction == AUIPC);
+}
+
+static bool is_invariant(const Loop *l, const IRNode *node) {
+    if (!ir_is_pure(node) || node->dest <= 0 || node->dest >= l->num_regs ||
+        l->num_defs[node->dest] != 1 || l->invariant[node->dest])
+        return false;
+
+    int regs[NUM_REGISTERS];
+    int n = ir_uses(node, regs);
+    for (int k = 0; k < n; k++) {
+        if (!is_invariant_reg(l, regs[k]))
+            return false;
+    }
+    return node->instruction != LOAD || is_invariant_load(l, node);
+}
+
+/**
+ * @brief Move the invariant instructions of the natural loop of a header
+ */
+static void hoist_loop(CFG *cfg, BasicBlock *header, bool *body, void *data) {
+    Loop *l = (Loop *)data;
+    IR *ir = l->ir;
+    l->cfg = cfg;
+    l->header = header;
+    l->body = body;
+    IRNode *pos = cfg_loop_entry(header, body);
+    if (pos == NULL)
+        return;
+
+    l->writes_memory = false;
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *b = cfg->rpo[i];
+        if (!l->body[b->id])
+            continue;
+        for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+            if (node->instruction == STORE || node->instruction == CALL)
+                l->writes_memory = true;
+        }
+    }
+
+    // reverse postorder visits a definition before the instructions it dominates
+    int capacity = 8, num_moved = 0;
+    IRNode **moved = (IRNode **)malloc(capacity * sizeof(IRNode *));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < cfg->num_reachable; i++) {
+            BasicBlock *b = cfg->rpo[i];
+            if (!l->body[b->id])
+                continue;
+            for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+                if (!is_invariant(l, node))
+                    continue;
+                if (num_moved == capacity) {
+                    capacity *= 2;
+                    moved = (IRNode **)realloc(moved, capacity * sizeof(IRNode *));
+                }
+                moved[num_moved++] = node;
+                l->invariant[node->dest] = true;
+                changed = true;
+            }
+        }
+    }
+
+    if (num_moved > 0) {
+        IRNode *comment = new_ir_node(COMMENT);
+        comment->comment = strdup("hoisted: loop invariants");
+        ir_insert_before(ir, pos, comment);
+    }
+    for (int i = 0; i < num_moved; i++) {
+        IRNode *node = moved[i];
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        ir_insert_before(ir, pos, node);
+        l->invariant[node->dest] = false;
+    }
+    free(moved);
+}
+
+void hoist_loop_invariants(IR *ir, IRFunction *fn) {
+    Loop l = {0};
+    l.ir = ir;
+    l.num_regs = ir->next_temp_reg;
+    l.num_defs = (int *)calloc(l.num_regs, sizeof(int));
+    l.def = (IRNode **)calloc(l.num_regs, sizeof(IRNode *));
+    l.invariant = (bool *)calloc(l.num_regs, sizeof(bool));
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        if (node->dest > 0 && l.num_defs[node->dest]++ == 0)
+            l.def[node->dest] = node;
+        else if (node->dest > 0)
+            l.def[node->dest] = NULL;
+    }
+
+    // moving instructions changes the blocks, see `cfg_for_each_loop`
+    cfg_for_each_loop(fn, hoist_loop, &l);
+
+    free(l.invariant);
+    free(l.def);
+    free(l.num_defs);
+}
@@ -0,0 +1,34 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Move the loop-invariant instructions of a function in SSA form out
+ *        of its loops
+ *
+ * A loop is the natural loop of a header (a `start_while` label): the
+ * blocks reaching one of its back edges without going through it. Loops
+ * are processed innermost first, so an instruction moved out of an inner
+ * loop can leave the outer one as well.
+ *
+ * An instruction is invariant when it only writes its virtual register
+ * (moves, constants and arithmetic), and every operand is `x0`, `fp`, `gp` or
+ * defined outside the loop or by another invariant instruction. A load is
+ * invariant too when nothing in the loop may write the address:
+ * - a load from the incoming arguments (`fp` plus a non-negative offset),
+ *   as long as the loop does not store to the same slot;
+ * - any other load, if the loop has no `store` and no `call`, and either
+ *   the address is always valid (a frame slot or a global) or the load runs
+ *   on every iteration that may leave the loop.
+ *
+ * The invariant instructions are moved, in order, to the preheader: the
+ * end of the only block entering the loop from outside, right before the
+ * loop header. Loops entered from several blocks are left alone.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function in SSA form (see ssa.h)
+ */
+void hoist_loop_invariants(IR *ir, IRFunction *fn);
+
+#endif // LICM_H
@@ -0,0 +1,251 @@
+#include "peephole.h"
+#include "../global.h"
+#include "../utils/ir.h"
+#include "../utils/object_code.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Number of instructions a rule may look past the first one */
+#define WINDOW 4
+
+/**
+ * @struct Peephole
+ * @brief State of the pass
+ */
+typedef struct Peephole {
+    IR *ir;
+    const int *map;
+} Peephole;
+
+/**
+ * @brief Rewrite starting at an instruction
+ *
+ * @return true if the rule matched and changed the IR; `node` may have been
+ *         removed then
+ */
+typedef bool (*RuleFn)(Peephole *p, IRNode *node);
+
+/**
+ * @struct Rule
+ * @brief Entry of the rule table
+ */
+typedef struct Rule {
+    const char *name;
+    RuleFn apply;
+} Rule;
+
+static int phys(const Peephole *p, int reg) {
+    return reg > 0 ? p->map[reg] : reg;
+}
+
+/**
+ * @brief Next instruction that is not a comment, NULL at the end
+ */
+static IRNode *next_code(IRNode *node) {
+    for (node = node->next; node != NULL; node = node->next) {
+        if (node->instruction != COMMENT)
+            return node;
+    }
+    return NULL;
+}
+
+static bool is_control(const IRNode *node) {
+    switch (node->instruction) {
+    case LABEL:
+    case JUMP:
+    case JUMP_REG:
+    case BEQ:
+    case BNE:
+    case BLE:
+    case BLT:
+    case BGE:
+    case BGT:
+    case CALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool reads(const Peephole *p, const IRNode *node, int reg) {
+    int regs[NUM_REGISTERS];
+    int n = ir_uses(node, regs);
+    for (int k = 0; k < n; k++) {
+        if (phys(p, regs[k]) == reg)
+            return true;
+    }
+    return false;
+}
+
+static bool writes(const Peephole *p, const IRNode *node, int reg) {
+    int regs[NUM_REGISTERS];
+    int n = ir_defs(node, regs);
+    for (int k = 0; k < n; k++) {
+        if (phys(p, regs[k]) == reg)
+            return true;
+    }
+    return false;
+}
+
+static bool remove_noop_move(Peephole *p, IRNode *node) {
+    bool is_move = node->instruction == MOV ||
+                   (node->instruction == ADD && node->src_kind == CONST_SRC && node->imm == 0);
+    if (!is_move || phys(p, node->dest) != phys(p, node->src1))
+        return false;
+    ir_remove(p->ir, node);
+    return true;
+}
+
+static bool is_sp_adjustment(const IRNode *node) {
+    return node->instruction == ADD && node->src_kind == CONST_SRC &&
+           node->dest == SP_REGISTER && node->src1 == SP_REGISTER;
+}
+
+static bool fuse_stack_adjustments(Peephole *p, IRNode *node) {
+    if (!is_sp_adjustment(node))
+        return false;
+
+    IRNode *next = next_code(node);
+    for (int i = 0; i < WINDOW && next != NULL; i++, next = next_code(next)) {
+        if (is_sp_adjustment(next))
+            break;
+        if (is_control(next) || reads(p, next, SP_REGISTER) || writes(p, next, SP_REGISTER))
+            return false;
+    }
+    if (next == NULL || !is_sp_adjustment(next))
+        return false;
+    long imm = node->imm + next->imm;
+    if (!ir_fits_immediate(imm))
+        return false;
+
+    // the instructions in between do not see `sp`, so the first adjustment can move down
+    next->imm = imm;
+    ir_remove(p->ir, node);
+    if (imm == 0)
+        ir_remove(p->ir, next);
+    return true;
+}
+
+static bool remove_jump_to_next(Peephole *p, IRNode *node) {
+    if (node->instruction != JUMP)
+        return false;
+    for (IRNode *next = node->next; next != NULL; next = next->next) {
+        if (next->instruction == LABEL && strcmp(next->comment, node->comment) == 0) {
+            ir_remove(p->ir, node);
+            return true;
+        }
+        if (next->instruction != LABEL && next->instruction != COMMENT)
+            break;
+    }
+    return false;
+}
+
+static bool use_zero_register(Peephole *p, IRNode *node) {
+    int reg = phys(p, node->dest);
+    if (node->instruction != LI || (int)node->imm != 0 || reg == X0_REGISTER)
+        return false;
+
+    // the reader must name the register as an operand, not read it implicitly
+    IRNode *reader = next_code(node);
+    if (reader == NULL || is_control(reader) || reader->instruction == ECALL ||
+        (phys(p, reader->src1) != reg && phys(p, reader->src2) != reg))
+        return false;
+
+    // the value must be dead after the reader
+    if (phys(p, reader->dest) != reg) {
+        IRNode *next = next_code(reader);
+        for (int i = 0; !writes(p, next, reg); i++) {
+            // a call reads its arguments without naming them
+            if (i == WINDOW || is_control(next) || reads(p, next, reg))
+                return false;
+            next = next_code(next);
+            if (next == NULL)
+                return false;
+        }
+    }
+
+    if (phys(p, reader->src1) == reg)
+        reader->src1 = X0_REGISTER;
+    if (phys(p, reader->src2) == reg)
+        reader->src2 = X0_REGISTER;
+    ir_remove(p->ir, node);
+    return true;
+}
+
+static bool invert_branch_over_jump(Peephole *p, IRNode *node) {
+    switch (node->instruction) {
+    case BEQ:
+    case BNE:
+    case BLE:
+    case BLT:
+    case BGE:
+    case BGT:
+        break;
+    default:
+        return false;
+    }
+    IRNode *jump = next_code(node);
+    if (jump == NULL || jump->instruction != JUMP)
+        return false;
+
+    for (IRNode *next = jump->next; next != NULL; next = next->next) {
+        if (next->instruction == LABEL && strcmp(next->comment, node->comment) == 0) {
+            node->instruction = ir_inverse_branch(node->instruction);
+            free(node->comment);
+            node->comment = strdup(jump->comment);
+            node->target = jump->target;
+            ir_remove(p->ir, jump);
+            return true;
+        }
+        if (next->instruction != LABEL && next->instruction != COMMENT)
+            break;
+    }
+    return false;
+}
+
+static const Rule rules[] = {
+    {"no-op move", remove_noop_move},
+    {"stack adjustment", fuse_stack_adjustments},
+    {"jump to next", remove_jump_to_next},
+    {"zero register", use_zero_register},
+    {"branch over jump", invert_branch_over_jump},
+};
+
+#define NUM_RULES (int)(sizeof(rules) / sizeof(rules[0]))
+
+void peephole_optimize(IR *ir, const int *map) {
+    Peephole p = {ir, map};
+    int hits[NUM_RULES] = {0};
+
+    IRNode *node = ir->head;
+    while (node != NULL) {
+        if (node->instruction == COMMENT) {
+            node = node->next;
+            continue;
+        }
+
+        // step back after a rewrite, it may complete an earlier pattern
+        IRNode *prev = node->prev;
+        while (prev != NULL && prev->instruction == COMMENT)
+            prev = prev->prev;
+        bool applied = false;
+        for (int r = 0; r < NUM_RULES && !applied; r++) {
+            if (rules[r].apply(&p, node)) {
+                hits[r]++;
+                applied = true;
+            }
+        }
+        if (!applied)
+            node = node->next;
+        else
+            node = prev != NULL ? prev : ir->head;
+    }
+
+    if (PeepholeStats) {
+        fprintf(listing, "Peephole optimization:\n");
+        for (int r = 0; r < NUM_RULES; r++)
+            fprintf(listing, "  %s: %d\n", rules[r].name, hits[r]);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Clean up the instruction stream after register assignment
+ *
+ * Slides a window of a few instructions (comments are skipped) over the
+ * whole IR and tries each rule of a table at every position; after a
+ * rewrite the window moves back one instruction, so rewrites can chain.
+ * The rules, in order:
+ * 1. **no-op move**: `mv` (or `addi` of 0) between registers assigned to
+ *    the same physical register is removed;
+ * 2. **stack adjustment**: two `addi sp, sp, N` separated only by
+ *    instructions not touching `sp` are fused, and removed if they cancel;
+ * 3. **jump to next**: a `j` to one of the labels right after it is
+ *    removed;
+ * 4. **zero register**: `li r, 0` whose value is read by the next
+ *    instruction only is removed and the read uses `zero` instead;
+ * 5. **branch over jump**: `b<cond> L1; j L2; L1:` becomes
+ *    `b<!cond> L2; L1:`.
+ *
+ * With `PeepholeStats` the number of rewrites of each rule is reported to
+ * the listing.
+ *
+ * @param ir Pointer to IR structure
+ * @param map Physical register of each virtual register, as returned by
+ *            `allocate_registers`
+ */
+void peephole_optimize(IR *ir, const int *map);
+
+#endif // PEEPHOLE_H
@@ -1,25 +1,25 @@
 #include "reg_allocation.h"
 #include "../global.h"
 #include "../utils/bitset.h"
+#include "../utils/cfg.h"
 #include "../utils/ir.h"
 #include "../utils/stack.h"
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * @struct AdjListNode
- * @brief Node in adjacency list for interference graph
- *
- * Represents a single edge in the interference graph using
- * adjacency list representation. Each node contains the ID
- * of an adjacent vertex and a pointer to the next adjacent vertex.
- */
-typedef struct AdjListNode {
-    int value;
-    struct AdjListNode *next;
-} AdjListNode;
+const PhysicalRegister register_file[NUM_ALLOCATABLE] = {
+    {-5, CALLER_SAVED},  {-6, CALLER_SAVED},  {-7, CALLER_SAVED},  {-28, CALLER_SAVED},
+    {-29, CALLER_SAVED}, {-30, CALLER_SAVED}, {-31, CALLER_SAVED}, {-10, ARGUMENT},
+    {-11, ARGUMENT},     {-12, ARGUMENT},     {-13, ARGUMENT},     {-14, ARGUMENT},
+    {-15, ARGUMENT},     {-16, ARGUMENT},     {-17, ARGUMENT},     {-9, CALLEE_SAVED},
+    {-18, CALLEE_SAVED}, {-19, CALLEE_SAVED}, {-20, CALLEE_SAVED}, {-21, CALLEE_SAVED},
+    {-22, CALLEE_SAVED}, {-23, CALLEE_SAVED}, {-24, CALLEE_SAVED}, {-25, CALLEE_SAVED},
+    {-26, CALLEE_SAVED}, {-27, CALLEE_SAVED},
+};
 
 /**
  * @struct InterferenceGraph
@@ -28,97 +28,120 @@ typedef struct AdjListNode {
  * Represents the interference relationships between virtual registers.
  * Two registers interfere if they are simultaneously live at some
  * program point, meaning they cannot be assigned to the same physical register.
+ *
+ * Edges are stored twice, Chaitin/Briggs style: a triangular bit-matrix
+ * answers "do u and v interfere?" in O(1) and keeps every edge unique, and
+ * a contiguous array of neighbors per node makes neighbor scans cheap.
+ * `num_neighbors[u]` is therefore the real degree of `u`.
  */
 typedef struct InterferenceGraph {
     int num_nodes;
+    BitSet *matrix; /**< bit u*(u-1)/2 + v is set when u > v interfere */
     int *num_neighbors;
-    AdjListNode **adj_list;
+    int *capacity;
+    int **adj_list;
 } InterferenceGraph;
 
 /**
- * @brief Perform liveness analysis on IR code
+ * @struct FunctionTemps
+ * @brief Dense numbering of the registers used by one function
  *
- * Computes live-in and live-out sets for each instruction using iterative
- * dataflow analysis. A register is "live" at a program point if its current
- * value may be used along some execution path starting from that point.
- *
- * The algorithm works backwards through the code, propagating liveness
- * information until a fixed point is reached. For each instruction:
- * - live_out[i] = union of live_in sets of all successors
- * - live_in[i] = use[i] ∪ (live_out[i] - def[i])
- *
- * Where:
- * - use[i] = registers read by instruction i
- * - def[i] = registers written by instruction i
+ * No virtual register is live across a function boundary, so each function
+ * is allocated on its own. Its registers are renumbered `0..num_temps-1`,
+ * followed by one precolored node per allocatable physical register
+ * (`num_temps + color`), and every bitset and graph of the function is
+ * sized to that count.
+ */
+typedef struct FunctionTemps {
+    IRFunction *fn;
+    int num_temps;
+    int num_colors; /**< number of allocatable physical registers */
+    int *temps;     /**< local index -> virtual register ID */
+    int *local;     /**< register ID -> node, -1 when unused (shared, valid from 1 - NUM_REGISTERS) */
+    IRNode **remat; /**< local index -> only definition if it loads a constant, NULL otherwise */
+} FunctionTemps;
+
+/**
+ * @brief Node of a register: its local index if virtual, `num_temps + color`
+ *        if physical and allocatable, -1 otherwise
+ */
+static inline int local_id(const FunctionTemps *ft, int reg) {
+    return ft->local[reg];
+}
+
+/**
+ * @brief Check if an instruction loads a constant (`li rd, imm` or
+ *        `addi rd, x0, imm`), so it can be repeated anywhere
+ */
+static bool is_constant_load(const IRNode *node) {
+    if (node->instruction == LI)
+        return true;
+    return node->instruction == ADD && node->src_kind == CONST_SRC && node->src1 == X0_REGISTER;
+}
+
+/**
+ * @brief Number the registers referenced by a function
  *
- * @param ir Pointer to IR structure to analyze
+ * Fills `ft->temps` and the shared `ft->local` table with a dense numbering
+ * of the virtual registers found between the function entry and exit,
+ * then numbers the allocatable physical registers after them. Registers
+ * defined once, by a constant load, are recorded in `ft->remat`.
  *
- * @note This function modifies the IR by setting live_in and live_out
- *       bitsets for each instruction node.
+ * @param ft Numbering to fill; `fn`, `num_colors` and `local` must be set
  */
-static void liveness_analysis(IR *ir) {
-    int num_temps = ir->next_temp_reg;
-    bool changed = true;
+static void number_temps(FunctionTemps *ft) {
+    int capacity = 16;
+    ft->num_temps = 0;
+    ft->temps = (int *)malloc(capacity * sizeof(int));
 
-    while (changed) {
-        changed = false;
-        for (IRNode *node = ir->tail; node != NULL; node = node->prev) {
-            if (node->instruction == COMMENT)
+    for (IRNode *node = ft->fn->entry; node != ft->fn->exit->next; node = node->next) {
+        int regs[] = {node->dest, node->src1, node->src2};
+        for (int i = 0; i < 3; i++) {
+            if (regs[i] <= 0 || ft->local[regs[i]] != -1)
                 continue;
-
-            // Find the next non-comment instruction (successor)
-            IRNode *succ = node->next;
-            while (succ != NULL && succ->instruction == COMMENT) {
-                succ = succ->next;
-            }
-            // For jump instructions, successor is the jump target
-            if (node->instruction == JUMP) {
-                succ = node->target;
+            if (ft->num_temps == capacity) {
+                capacity *= 2;
+                ft->temps = (int *)realloc(ft->temps, capacity * sizeof(int));
             }
+            ft->local[regs[i]] = ft->num_temps;
+            ft->temps[ft->num_temps++] = regs[i];
+        }
+    }
 
-            // `out[v]` = U_{w in succ(v)} `in[w]`
-            BitSet *new_out = succ == NULL ? NULL : bitset_copy(succ->live_in);
-
-            // Branch instructions have two successors: fall-through and branch target
-            if (node->instruction == BEQ || node->instruction == BNE || node->instruction == BLE ||
-                node->instruction == BLT || node->instruction == BGE || node->instruction == BGT) {
-                if (new_out == NULL && node->target->live_in != NULL)
-                    new_out = bitset_copy(node->target->live_in);
-                else
-                    bitset_union(new_out, node->target->live_in);
-            }
+    for (int color = 0; color < ft->num_colors; color++)
+        ft->local[register_file[color].reg] = ft->num_temps + color;
 
-            // `in[v]` <-  use(v) U (`out[v]` - def(v))
-            BitSet *new_in = new_out != NULL ? bitset_copy(new_out)
-                             : ((node->dest > 0) | (node->src1 > 0) | (node->src2 > 0))
-                                 ? new_bitset(num_temps)
-                                 : NULL;
-            if ((node->dest > 0) && (new_out != NULL) && (bitset_test(new_out, node->dest)))
-                bitset_clear(new_in, node->dest);
-            if (node->src1 > 0)
-                bitset_set(new_in, node->src1);
-            if (node->src2 > 0)
-                bitset_set(new_in, node->src2);
-
-            if (!bitset_equals(node->live_out, new_out) || !bitset_equals(node->live_in, new_in)) {
-                changed = true;
-                destroy_biset(node->live_out);
-                destroy_biset(node->live_in);
-                node->live_out = new_out;
-                node->live_in = new_in;
-            } else {
-                destroy_biset(new_out);
-                destroy_biset(new_in);
-            }
-        }
+    int *num_defs = (int *)calloc(ft->num_temps, sizeof(int));
+    ft->remat = (IRNode **)calloc(ft->num_temps, sizeof(IRNode *));
+    for (IRNode *node = ft->fn->entry; node != ft->fn->exit->next; node = node->next) {
+        if (node->dest <= 0)
+            continue;
+        int v = ft->local[node->dest];
+        ft->remat[v] = ++num_defs[v] == 1 && is_constant_load(node) ? node : NULL;
     }
+    free(num_defs);
+}
+
+/**
+ * @brief Reset the shared entries of the numbering and free it
+ */
+static void release_temps(FunctionTemps *ft) {
+    for (int i = 0; i < ft->num_temps; i++)
+        ft->local[ft->temps[i]] = -1;
+    for (int color = 0; color < ft->num_colors; color++)
+        ft->local[register_file[color].reg] = -1;
+    free(ft->temps);
+    free(ft->remat);
+    ft->temps = NULL;
+    ft->remat = NULL;
+    ft->num_temps = 0;
 }
 
 /**
  * @brief Create a new interference graph
  *
  * Allocates memory for an interference graph with the specified number
- * of nodes and initializes all adjacency lists to empty.
+ * of nodes, an empty bit-matrix and empty adjacency arrays.
  *
  * @param n_nodes Number of nodes (virtual registers) in the graph
  * @return Pointer to newly created interference graph
@@ -126,17 +149,28 @@ static void liveness_analysis(IR *ir) {
 static InterferenceGraph *create_graph(int n_nodes) {
     InterferenceGraph *g = (InterferenceGraph *)malloc(sizeof(InterferenceGraph));
     g->num_nodes = n_nodes;
-    g->num_neighbors = (int *)malloc(n_nodes * sizeof(int));
-    g->adj_list = (AdjListNode **)malloc(n_nodes * sizeof(AdjListNode *));
-
-    for (int n = 0; n < n_nodes; n++) {
-        g->num_neighbors[n] = 0;
-        g->adj_list[n] = NULL;
-    }
+    g->matrix = new_bitset(n_nodes * (n_nodes - 1) / 2);
+    g->num_neighbors = (int *)calloc(n_nodes, sizeof(int));
+    g->capacity = (int *)calloc(n_nodes, sizeof(int));
+    g->adj_list = (int **)calloc(n_nodes, sizeof(int *));
 
     return g;
 }
 
+/**
+ * @brief Position of the pair (u, v) in the triangular bit-matrix
+ */
+static inline int matrix_index(int u, int v) {
+    return u > v ? u * (u - 1) / 2 + v : v * (v - 1) / 2 + u;
+}
+
+/**
+ * @brief Check if two nodes interfere
+ */
+static inline bool interferes(const InterferenceGraph *g, int u, int v) {
+    return u != v && bitset_test(g->matrix, matrix_index(u, v));
+}
+
 /**
  * @brief Print interference graph for debugging
  *
@@ -148,13 +182,24 @@ static InterferenceGraph *create_graph(int n_nodes) {
 static void print_graph(InterferenceGraph *g) {
     for (int u = 0; u < g->num_nodes; u++) {
         printf("Neighbors of %d: ", u);
-        for (AdjListNode *v = g->adj_list[u]; v != NULL; v = v->next) {
-            printf("%d ", v->value);
+        for (int i = 0; i < g->num_neighbors[u]; i++) {
+            printf("%d ", g->adj_list[u][i]);
         }
         printf("\n");
     }
 }
 
+/**
+ * @brief Append a node to the adjacency array of another one
+ */
+static void push_neighbor(InterferenceGraph *g, int u, int v) {
+    if (g->num_neighbors[u] == g->capacity[u]) {
+        g->capacity[u] = g->capacity[u] == 0 ? 4 : 2 * g->capacity[u];
+        g->adj_list[u] = (int *)realloc(g->adj_list[u], g->capacity[u] * sizeof(int));
+    }
+    g->adj_list[u][g->num_neighbors[u]++] = v;
+}
+
 /**
  * @brief Add an undirected edge to the interference graph
  *
@@ -166,103 +211,339 @@ static void print_graph(InterferenceGraph *g) {
  * @param u First virtual register ID
  * @param v Second virtual register ID
  *
- * @note Self-loops (u == v) are ignored since a register doesn't
- *       interfere with itself.
+ * @note Self-loops (u == v) and edges already in the graph are ignored,
+ *       so the adjacency arrays never hold duplicates.
  */
 static void add_edge(InterferenceGraph *g, int u, int v) {
-    if (u == v)
+    if (u == v || interferes(g, u, v))
         return;
 
-    // Add edge u -> v
-    AdjListNode *new_u = (AdjListNode *)malloc(sizeof(AdjListNode));
-    new_u->value = v;
-    new_u->next = g->adj_list[u];
-    g->adj_list[u] = new_u;
-    g->num_neighbors[u] += 1;
-
-    // Add edge v -> u (undirected graph)
-    AdjListNode *new_v = (AdjListNode *)malloc(sizeof(AdjListNode));
-    new_v->value = u;
-    new_v->next = g->adj_list[v];
-    g->adj_list[v] = new_v;
-    g->num_neighbors[v] += 1;
+    bitset_set(g->matrix, matrix_index(u, v));
+    push_neighbor(g, u, v);
+    push_neighbor(g, v, u);
 }
 
 /**
  * @brief Free memory used by interference graph
  *
  * Deallocates all memory associated with the interference graph
- * including adjacency lists and the graph structure itself.
+ * including the bit-matrix, the adjacency arrays and the graph itself.
  *
  * @param g Pointer to interference graph to destroy
  */
 static void destroy_graph(InterferenceGraph *g) {
-    free(g->num_neighbors);
-    for (int u = 0; u < g->num_nodes; u++) {
-        AdjListNode *node = g->adj_list[u];
-        AdjListNode *next = NULL;
-        while (node != NULL) {
-            next = node->next;
-            free(node);
-            node = next;
-        }
-    }
+    if (g == NULL)
+        return;
+
+    for (int u = 0; u < g->num_nodes; u++)
+        free(g->adj_list[u]);
     free(g->adj_list);
+    free(g->capacity);
+    free(g->num_neighbors);
+    destroy_biset(g->matrix);
     free(g);
 }
 
 /**
- * @brief Build interference graph from IR with liveness information
+ * @brief Build interference graph of a function with liveness information
+ *
+ * Computes block-level liveness on the control-flow graph of the function,
+ * then walks each block backwards from its live-out set to recover the
+ * registers live after every instruction. A register defined by an
+ * instruction interferes with all registers live after it, since they
+ * cannot share the same physical register. Only the set bits of the live
+ * set are visited, so the cost follows the number of interfering pairs.
  *
- * Constructs the interference graph by examining each instruction that
- * defines a register. A register interferes with all registers that are
- * live after the instruction (live_out set), since they cannot share
- * the same physical register.
+ * Physical registers are precolored nodes: implicit definitions keep the
+ * virtual registers live across them out of those registers. In particular
+ * a `call` defines every caller-saved register, so a value live across a
+ * call can only get a callee-saved register or, when none is left, be
+ * spilled, i.e. stored once after its definition and reloaded at its uses.
+ * Edges between two physical registers are never needed and are not added.
  *
- * @param ir Pointer to IR structure (must have liveness analysis completed)
- * @return Pointer to constructed interference graph
+ * The destination of a move does not interfere with its source, so that
+ * the move can later be coalesced.
+ *
+ * @param ft Register numbering of the function
+ * @param cfg Control-flow graph of the function
+ * @return Pointer to constructed interference graph, indexed by local IDs
  */
-static InterferenceGraph *build_graph(IR *ir) {
-    int num_temps = ir->next_temp_reg;
-    InterferenceGraph *g = create_graph(num_temps);
-    liveness_analysis(ir);
+static InterferenceGraph *build_graph(const FunctionTemps *ft, CFG *cfg) {
+    int num_temps = ft->num_temps;
+    int num_nodes = num_temps + ft->num_colors;
+    InterferenceGraph *g = create_graph(num_nodes);
+    cfg_liveness(cfg, ft->local, num_nodes);
+
+    int regs[NUM_REGISTERS];
+    BitSet *live = new_bitset(num_nodes);
+    for (int i = 0; i < cfg->num_blocks; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        bitset_assign(live, b->live_out);
 
-    for (IRNode *node = ir->head; node != NULL; node = node->next) {
-        if (node->dest > 0) {
-            for (int j = 1; j < num_temps; j++) {
-                if (bitset_test(node->live_out, j)) {
-                    add_edge(g, node->dest, j);
+        for (IRNode *node = b->last; node != b->first->prev; node = node->prev) {
+            // the two sides of a move hold the same value, they do not interfere
+            int moved = node->instruction == MOV ? local_id(ft, node->src1) : -1;
+
+            int n = ir_defs(node, regs);
+            for (int k = 0; k < n; k++) {
+                int dest = local_id(ft, regs[k]);
+                if (dest < 0)
+                    continue;
+                BITSET_FOREACH(j, live) {
+                    if (j != moved && (dest < num_temps || j < num_temps))
+                        add_edge(g, dest, j);
                 }
             }
+            for (int k = 0; k < n; k++) {
+                if (local_id(ft, regs[k]) >= 0)
+                    bitset_clear(live, local_id(ft, regs[k]));
+            }
+
+            n = ir_uses(node, regs);
+            for (int k = 0; k < n; k++) {
+                if (local_id(ft, regs[k]) >= 0)
+                    bitset_set(live, local_id(ft, regs[k]));
+            }
         }
     }
 
+    destroy_biset(live);
     return g;
 }
 
 /**
- * @brief Color the interference graph using greedy algorithm
+ * @brief Representative of a node after the coalescing done so far
+ */
+static int find_alias(int *alias, int u) {
+    while (alias[u] != u) {
+        alias[u] = alias[alias[u]];
+        u = alias[u];
+    }
+    return u;
+}
+
+/**
+ * @brief George test: can virtual node `v` be merged into node `u`?
+ *
+ * Safe when every neighbor of `v` already interferes with `u`, has fewer
+ * than `k` neighbors, or is precolored. Used when `u` is precolored, whose
+ * neighbor list is not known in full.
+ */
+static bool george_test(const InterferenceGraph *g, int *alias, const int *degree, int num_temps,
+                        int k, int u, int v) {
+    for (int i = 0; i < g->num_neighbors[v]; i++) {
+        int t = g->adj_list[v][i];
+        if (alias[t] != t || t >= num_temps)
+            continue;
+        if (degree[t] >= k && !interferes(g, t, u))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Briggs test: can virtual nodes `u` and `v` be merged?
+ *
+ * Safe when the merged node has fewer than `k` neighbors of significant
+ * degree (`k` or more), precolored neighbors counting as significant.
+ */
+static bool briggs_test(const InterferenceGraph *g, int *alias, const int *degree, int num_temps,
+                        int k, int u, int v) {
+    int significant = 0;
+    int nodes[] = {u, v};
+    for (int n = 0; n < 2; n++) {
+        for (int i = 0; i < g->num_neighbors[nodes[n]]; i++) {
+            int t = g->adj_list[nodes[n]][i];
+            if (alias[t] != t)
+                continue;
+            // neighbors of both are seen from u, and lose one edge when merged
+            bool shared = interferes(g, t, u) && interferes(g, t, v);
+            if (n == 1 && shared)
+                continue;
+            if (t >= num_temps || degree[t] - (shared ? 1 : 0) >= k)
+                significant++;
+        }
+    }
+    return significant < k;
+}
+
+/**
+ * @brief Conservatively coalesce the moves of a function
+ *
+ * Visits every `mv` whose operands are allocatable and do not interfere,
+ * and merges them when it cannot make the graph harder to color: the
+ * George test is used when one side is a precolored register (e.g. `a0`
+ * around calls and returns), the Briggs test otherwise. The graph is
+ * updated as nodes merge, so a single pass may coalesce chains of moves.
+ * Registers created by spill code are only merged into physical registers,
+ * so the live ranges that cannot be spilled stay short.
+ *
+ * The merged registers are then renamed in the IR and the moves that
+ * became `mv r, r` are deleted.
+ *
+ * @param ir Pointer to IR structure
+ * @param ft Register numbering of the function
+ * @param g Interference graph of the function, updated by the merges
+ * @param first_unspillable First register ID created by spill code
+ * @return Number of moves removed
+ */
+static int coalesce_moves(IR *ir, const FunctionTemps *ft, InterferenceGraph *g,
+                          int first_unspillable) {
+    int num_temps = ft->num_temps, k = ft->num_colors;
+    int *alias = (int *)malloc(g->num_nodes * sizeof(int));
+    int *degree = (int *)malloc(g->num_nodes * sizeof(int));
+    for (int i = 0; i < g->num_nodes; i++)
+        alias[i] = i;
+    memcpy(degree, g->num_neighbors, g->num_nodes * sizeof(int));
+
+    int merged = 0;
+    for (IRNode *node = ft->fn->entry; node != ft->fn->exit; node = node->next) {
+        if (node->instruction != MOV || local_id(ft, node->dest) < 0 ||
+            local_id(ft, node->src1) < 0)
+            continue;
+
+        int u = find_alias(alias, local_id(ft, node->dest));
+        int v = find_alias(alias, local_id(ft, node->src1));
+        if (v >= num_temps) {
+            int tmp = u;
+            u = v;
+            v = tmp;
+        }
+        if (u == v || v >= num_temps || interferes(g, u, v))
+            continue;
+
+        bool ok;
+        if (u >= num_temps)
+            ok = george_test(g, alias, degree, num_temps, k, u, v);
+        else if (ft->temps[u] >= first_unspillable || ft->temps[v] >= first_unspillable)
+            ok = false;
+        else
+            ok = briggs_test(g, alias, degree, num_temps, k, u, v);
+        if (!ok)
+            continue;
+
+        // merge v into u
+        alias[v] = u;
+        merged++;
+        for (int i = 0; i < g->num_neighbors[v]; i++) {
+            int t = g->adj_list[v][i];
+            if (alias[t] != t)
+                continue;
+            if (interferes(g, t, u)) {
+                degree[t]--;
+            } else if (u < num_temps || t < num_temps) {
+                add_edge(g, u, t);
+                degree[u]++;
+            }
+        }
+    }
+
+    if (merged > 0) {
+        for (IRNode *node = ft->fn->entry; node != ft->fn->exit;) {
+            int *operands[] = {&node->dest, &node->src1, &node->src2};
+            for (int i = 0; i < 3; i++) {
+                if (*operands[i] <= 0)
+                    continue;
+                int r = find_alias(alias, local_id(ft, *operands[i]));
+                *operands[i] = r < num_temps ? ft->temps[r] : register_file[r - num_temps].reg;
+            }
+
+            IRNode *next = node->next;
+            if (node->instruction == MOV && node->dest == node->src1)
+                ir_remove(ir, node);
+            node = next;
+        }
+    }
+
+    free(degree);
+    free(alias);
+    return merged;
+}
+
+/**
+ * @brief Compute the spill weight of every virtual register of a function
+ *
+ * The weight of a register is the number of instructions that read or
+ * write it, i.e. the number of loads and stores spilling it would add,
+ * each weighted by 10^depth, depth being the loop nesting depth of its
+ * block, since code in loops runs many times. Spilling a rematerializable
+ * register deletes its definition and turns each use into a constant
+ * load, which needs no memory access, so only its uses count and at half
+ * the price. Registers created by a previous spill round (IDs from
+ * `first_unspillable` on) have tiny live ranges and spilling them again
+ * would not reduce pressure, so they get an infinite weight.
+ *
+ * The `block` of every instruction must point to its block in a
+ * control-flow graph whose loop depths were computed by `cfg_loop_depth`.
+ *
+ * @param ft Register numbering of the function
+ * @param first_unspillable First register ID created by spill code
+ * @return Array indexed by local ID with the spill weight of each register
+ */
+static double *spill_weights(const FunctionTemps *ft, int first_unspillable) {
+    double *weight = (double *)calloc(ft->num_temps, sizeof(double));
+
+    for (IRNode *node = ft->fn->entry; node != ft->fn->exit->next; node = node->next) {
+        double cost = pow(10, node->block->loop_depth);
+        int regs[] = {node->dest, node->src1, node->src2};
+        for (int i = 0; i < 3; i++) {
+            if (regs[i] <= 0)
+                continue;
+            int v = ft->local[regs[i]];
+            if (ft->remat[v] == NULL)
+                weight[v] += cost;
+            else if (i > 0)
+                weight[v] += cost / 2;
+        }
+    }
+
+    for (int i = 0; i < ft->num_temps; i++) {
+        if (ft->temps[i] >= first_unspillable)
+            weight[i] = INFINITY;
+    }
+
+    return weight;
+}
+
+/**
+ * @brief Color the interference graph using optimistic coloring
  *
  * Assigns colors (physical registers) to nodes (virtual registers) such that
  * no two adjacent nodes have the same color. Uses a stack-based approach:
  *
  * 1. **Simplification**: Remove nodes with < K neighbors and push onto stack
- * 2. **Spilling**: If no such nodes exist, select node with most neighbors
- * 3. **Coloring**: Pop nodes from stack and assign first available color
+ * 2. **Potential spill**: If no such nodes exist, push the node with the
+ *    lowest spill cost (weight / degree) and keep simplifying
+ * 3. **Coloring**: Pop nodes from stack and assign first available color;
+ *    nodes left without a color become actual spills
+ *
+ * The nodes after the virtual registers are precolored: node
+ * `num_temps + c` always has color `c` and is never simplified.
  *
  * @param g Pointer to interference graph to color
  * @param num_temps Number of virtual registers (nodes)
  * @param num_colors Number of available colors (physical registers)
- * @return Array mapping virtual register IDs to assigned colors
- *
- * @note If a node cannot be colored (register spilling required),
- *       the function reports an error and sets the global Error flag.
+ * @param weight Spill weight of each virtual register
+ * @param spilled Output array flagging the virtual registers to spill
+ * @return Array mapping local register IDs to assigned colors
  */
-static int *color_graph(InterferenceGraph *g, int num_temps, int num_colors) {
-    int *map = (int *)malloc(num_temps * sizeof(int));
-    bool *active = (bool *)malloc(num_temps * sizeof(bool));
-    for (int i = 0; i < num_temps; i++)
+static int *color_graph(InterferenceGraph *g, int num_temps, int num_colors, double *weight,
+                        bool *spilled) {
+    int *map = (int *)malloc(g->num_nodes * sizeof(int));
+    bool *active = (bool *)malloc(g->num_nodes * sizeof(bool));
+    for (int i = 0; i < num_temps; i++) {
+        map[i] = 0;
+        active[i] = true;
+        spilled[i] = false;
+    }
+    for (int i = num_temps; i < g->num_nodes; i++) {
+        map[i] = i - num_temps;
         active[i] = true;
+    }
+
+    // degrees are consumed by simplification, the graph keeps the original ones
+    int *degree = (int *)malloc(g->num_nodes * sizeof(int));
+    memcpy(degree, g->num_neighbors, g->num_nodes * sizeof(int));
 
     Stack *stack = s_create();
     int num_nodes = num_temps;
@@ -273,18 +554,22 @@ static int *color_graph(InterferenceGraph *g, int num_temps, int num_colors) {
 
         // First, try to find a node with < K neighbors (guaranteed colorable)
         for (int i = 0; i < num_temps; i++) {
-            if (active[i] &&
-                ((g->num_neighbors[i] > max_neighbors && g->num_neighbors[i] < num_colors))) {
-                max_neighbors = g->num_neighbors[i];
+            if (active[i] && ((degree[i] > max_neighbors && degree[i] < num_colors))) {
+                max_neighbors = degree[i];
                 sel_node = i;
             }
         }
 
-        // If no such node exists, select node with most neighbors (spill candidate)
+        // If no such node exists, select the cheapest node to spill (potential spill)
         if (sel_node == -1) {
+            double min_cost = INFINITY;
             for (int i = 0; i < num_temps; i++) {
-                if (active[i] && g->num_neighbors[i] > max_neighbors) {
-                    max_neighbors = g->num_neighbors[i];
+                if (!active[i])
+                    continue;
+                int n = g->num_neighbors[i];
+                double cost = weight[i] / (n > 0 ? n : 1);
+                if (sel_node == -1 || cost < min_cost) {
+                    min_cost = cost;
                     sel_node = i;
                 }
             }
@@ -294,9 +579,9 @@ static int *color_graph(InterferenceGraph *g, int num_temps, int num_colors) {
         active[sel_node] = false;
 
         // remove all nodes linked to the selected
-        g->num_neighbors[sel_node] = 0;
-        for (AdjListNode *node = g->adj_list[sel_node]; node != NULL; node = node->next) {
-            g->num_neighbors[node->value]--;
+        degree[sel_node] = 0;
+        for (int i = 0; i < g->num_neighbors[sel_node]; i++) {
+            degree[g->adj_list[sel_node][i]]--;
         }
         num_nodes--;
     }
@@ -305,12 +590,15 @@ static int *color_graph(InterferenceGraph *g, int num_temps, int num_colors) {
     while (!s_empty(stack)) {
         bool found = false;
         int v = s_top(stack);
+        s_pop(stack);
+
         for (int color = 0; color < num_colors; color++) {
             bool available = true;
 
             // Check if any active neighbor already uses this color
-            for (AdjListNode *u = g->adj_list[v]; u != NULL; u = u->next) {
-                available = available && !(active[u->value] && map[u->value] == color);
+            for (int i = 0; i < g->num_neighbors[v]; i++) {
+                int u = g->adj_list[v][i];
+                available = available && !(active[u] && map[u] == color);
 
                 if (!available)
                     break;
@@ -324,38 +612,1106 @@ static int *color_graph(InterferenceGraph *g, int num_temps, int num_colors) {
             }
         }
 
-        // If no color available, register spilling is required
+        // If no color available, the node is an actual spill and stays inactive
         if (!found) {
-            fprintf(listing,
-                    "\033[1;31mFatal Error\033[0m: %d registers are not enough, must spill\n",
-                    num_colors);
-            Error = true;
-            break;
+            spilled[v] = true;
+            continue;
         }
 
         active[v] = true;
-        s_pop(stack);
     }
 
     s_destroy(stack);
+    free(degree);
     free(active);
 
     return map;
 }
 
+/**
+ * @enum NodeList
+ * @brief Sets a node belongs to during iterated register coalescing
+ */
+typedef enum NodeList {
+    PRECOLORED,        /**< physical registers, never simplified nor spilled */
+    SIMPLIFY_WORKLIST, /**< low-degree nodes not related to any move */
+    FREEZE_WORKLIST,   /**< low-degree move-related nodes */
+    SPILL_WORKLIST,    /**< high-degree nodes */
+    SPILLED_NODES,     /**< nodes left without a color */
+    COALESCED_NODES,   /**< nodes merged into another one (see `alias`) */
+    COLORED_NODES,     /**< nodes given a color */
+    SELECT_STACK,      /**< nodes removed from the graph, waiting for a color */
+    NUM_NODE_LISTS
+} NodeList;
+
+/**
+ * @enum MoveList
+ * @brief Sets a move belongs to during iterated register coalescing
+ */
+typedef enum MoveList {
+    COALESCED_MOVES,   /**< moves whose operands were merged */
+    CONSTRAINED_MOVES, /**< moves whose operands interfere */
+    FROZEN_MOVES,      /**< moves given up on */
+    WORKLIST_MOVES,    /**< moves that may be coalescible */
+    ACTIVE_MOVES,      /**< moves not ready for coalescing yet */
+    NUM_MOVE_LISTS
+} MoveList;
+
+/**
+ * @struct Lists
+ * @brief Partition of `0..n-1` into doubly linked lists
+ *
+ * Every element is in exactly one list, moving an element and testing its
+ * list take constant time, and lists are used as stacks (push and pop at
+ * the head).
+ */
+typedef struct Lists {
+    int *which; /**< list holding each element, -1 before the first push */
+    int *next, *prev;
+    int *head; /**< first element of each list, -1 when empty */
+} Lists;
+
+static void lists_init(Lists *l, int num_elems, int num_lists) {
+    l->which = (int *)malloc(num_elems * sizeof(int));
+    l->next = (int *)malloc(num_elems * sizeof(int));
+    l->prev = (int *)malloc(num_elems * sizeof(int));
+    l->head = (int *)malloc(num_lists * sizeof(int));
+    for (int i = 0; i < num_elems; i++)
+        l->which[i] = -1;
+    for (int i = 0; i < num_lists; i++)
+        l->head[i] = -1;
+}
+
+/**
+ * @brief Move an element to the head of a list
+ */
+static void lists_move(Lists *l, int e, int list) {
+    if (l->which[e] >= 0) {
+        if (l->prev[e] >= 0)
+            l->next[l->prev[e]] = l->next[e];
+        else
+            l->head[l->which[e]] = l->next[e];
+        if (l->next[e] >= 0)
+            l->prev[l->next[e]] = l->prev[e];
+    }
+
+    l->which[e] = list;
+    l->prev[e] = -1;
+    l->next[e] = l->head[list];
+    if (l->head[list] >= 0)
+        l->prev[l->head[list]] = e;
+    l->head[list] = e;
+}
+
+static void lists_free(Lists *l) {
+    free(l->which);
+    free(l->next);
+    free(l->prev);
+    free(l->head);
+}
+
+/**
+ * @struct IRC
+ * @brief State of iterated register coalescing on one function
+ *
+ * Nodes are the ones of the interference graph: the virtual registers
+ * followed by the precolored physical registers. Moves are the `mv`
+ * instructions between two allocatable registers.
+ */
+typedef struct IRC {
+    InterferenceGraph *g;
+    int num_temps;
+    int k;
+    const double *weight;
+
+    Lists nodes;
+    int *degree;
+    int *alias;
+    int *color;
+
+    Lists moves;
+    int num_moves;
+    int (*move_ends)[2]; /**< destination and source node of each move */
+    int **move_list;     /**< moves each node takes part in */
+    int *num_move_list;
+    int *cap_move_list;
+} IRC;
+
+/**
+ * @brief Check if a node is still in the graph (not removed nor merged)
+ */
+static inline bool irc_in_graph(const IRC *irc, int n) {
+    return irc->nodes.which[n] != SELECT_STACK && irc->nodes.which[n] != COALESCED_NODES;
+}
+
+/**
+ * @brief Check if a move may still be coalesced
+ */
+static inline bool irc_pending_move(const IRC *irc, int m) {
+    return irc->moves.which[m] == ACTIVE_MOVES || irc->moves.which[m] == WORKLIST_MOVES;
+}
+
+static void irc_add_move(IRC *irc, int n, int m) {
+    if (irc->num_move_list[n] == irc->cap_move_list[n]) {
+        irc->cap_move_list[n] = irc->cap_move_list[n] == 0 ? 2 : 2 * irc->cap_move_list[n];
+        irc->move_list[n] =
+            (int *)realloc(irc->move_list[n], irc->cap_move_list[n] * sizeof(int));
+    }
+    irc->move_list[n][irc->num_move_list[n]++] = m;
+}
+
+static bool irc_move_related(IRC *irc, int n) {
+    for (int i = 0; i < irc->num_move_list[n]; i++) {
+        int m = irc->move_list[n][i];
+        if (irc_pending_move(irc, m))
+            return true;
+    }
+    return false;
+}
+
+static void irc_enable_moves(IRC *irc, int n) {
+    for (int i = 0; i < irc->num_move_list[n]; i++) {
+        int m = irc->move_list[n][i];
+        if (!irc_pending_move(irc, m))
+            continue;
+        if (irc->moves.which[m] == ACTIVE_MOVES)
+            lists_move(&irc->moves, m, WORKLIST_MOVES);
+    }
+}
+
+static int irc_get_alias(IRC *irc, int n) {
+    while (irc->nodes.which[n] == COALESCED_NODES)
+        n = irc->alias[n];
+    return n;
+}
+
+static void irc_add_edge(IRC *irc, int u, int v) {
+    bool pu = irc->nodes.which[u] == PRECOLORED, pv = irc->nodes.which[v] == PRECOLORED;
+    if (u == v || (pu && pv) || interferes(irc->g, u, v))
+        return;
+
+    add_edge(irc->g, u, v);
+    if (!pu)
+        irc->degree[u]++;
+    if (!pv)
+        irc->degree[v]++;
+}
+
+static void irc_decrement_degree(IRC *irc, int m) {
+    if (irc->nodes.which[m] == PRECOLORED)
+        return;
+
+    int d = irc->degree[m]--;
+    if (d == irc->k) {
+        irc_enable_moves(irc, m);
+        for (int i = 0; i < irc->g->num_neighbors[m]; i++) {
+            int t = irc->g->adj_list[m][i];
+            if (!irc_in_graph(irc, t))
+                continue;
+            irc_enable_moves(irc, t);
+        }
+        lists_move(&irc->nodes, m, irc_move_related(irc, m) ? FREEZE_WORKLIST : SIMPLIFY_WORKLIST);
+    }
+}
+
+static void irc_simplify(IRC *irc) {
+    int n = irc->nodes.head[SIMPLIFY_WORKLIST];
+    lists_move(&irc->nodes, n, SELECT_STACK);
+    for (int i = 0; i < irc->g->num_neighbors[n]; i++) {
+        int m = irc->g->adj_list[n][i];
+        if (!irc_in_graph(irc, m))
+            continue;
+        irc_decrement_degree(irc, m);
+    }
+}
+
+static void irc_add_work_list(IRC *irc, int u) {
+    if (irc->nodes.which[u] != PRECOLORED && !irc_move_related(irc, u) && irc->degree[u] < irc->k)
+        lists_move(&irc->nodes, u, SIMPLIFY_WORKLIST);
+}
+
+/**
+ * @brief George test: merging `v` into precolored `r` is safe for neighbor `t`
+ */
+static bool irc_ok(IRC *irc, int t, int r) {
+    return irc->degree[t] < irc->k || irc->nodes.which[t] == PRECOLORED || interferes(irc->g, t, r);
+}
+
+/**
+ * @brief Briggs test: the merged node has fewer than K significant neighbors
+ */
+static bool irc_conservative(IRC *irc, int u, int v) {
+    int significant = 0;
+    for (int i = 0; i < irc->g->num_neighbors[u]; i++) {
+        int t = irc->g->adj_list[u][i];
+        if (!irc_in_graph(irc, t))
+            continue;
+        if (irc->degree[t] >= irc->k)
+            significant++;
+    }
+    for (int i = 0; i < irc->g->num_neighbors[v]; i++) {
+        int t = irc->g->adj_list[v][i];
+        if (!irc_in_graph(irc, t))
+            continue;
+        if (!interferes(irc->g, t, u) && irc->degree[t] >= irc->k)
+            significant++;
+    }
+    return significant < irc->k;
+}
+
+static void irc_combine(IRC *irc, int u, int v) {
+    lists_move(&irc->nodes, v, COALESCED_NODES);
+    irc->alias[v] = u;
+    for (int i = 0; i < irc->num_move_list[v]; i++)
+        irc_add_move(irc, u, irc->move_list[v][i]);
+    irc_enable_moves(irc, v);
+
+    for (int i = 0; i < irc->g->num_neighbors[v]; i++) {
+        int t = irc->g->adj_list[v][i];
+        if (!irc_in_graph(irc, t))
+            continue;
+        irc_add_edge(irc, t, u);
+        irc_decrement_degree(irc, t);
+    }
+    if (irc->degree[u] >= irc->k && irc->nodes.which[u] == FREEZE_WORKLIST)
+        lists_move(&irc->nodes, u, SPILL_WORKLIST);
+}
+
+static void irc_coalesce(IRC *irc) {
+    int m = irc->moves.head[WORKLIST_MOVES];
+    int x = irc_get_alias(irc, irc->move_ends[m][0]);
+    int y = irc_get_alias(irc, irc->move_ends[m][1]);
+    int u = x, v = y;
+    if (irc->nodes.which[y] == PRECOLORED) {
+        u = y;
+        v = x;
+    }
+    bool u_precolored = irc->nodes.which[u] == PRECOLORED;
+
+    if (u == v) {
+        lists_move(&irc->moves, m, COALESCED_MOVES);
+        irc_add_work_list(irc, u);
+    } else if (irc->nodes.which[v] == PRECOLORED || interferes(irc->g, u, v) ||
+               (!u_precolored && (irc->weight[u] == INFINITY || irc->weight[v] == INFINITY))) {
+        // registers created by spill code are kept short, they cannot be spilled again
+        lists_move(&irc->moves, m, CONSTRAINED_MOVES);
+        irc_add_work_list(irc, u);
+        irc_add_work_list(irc, v);
+    } else {
+        bool ok = true;
+        if (u_precolored) {
+            for (int i = 0; i < irc->g->num_neighbors[v]; i++) {
+                int t = irc->g->adj_list[v][i];
+                if (!irc_in_graph(irc, t))
+                    continue;
+                ok = ok && irc_ok(irc, t, u);
+            }
+        } else {
+            ok = irc_conservative(irc, u, v);
+        }
+
+        if (ok) {
+            lists_move(&irc->moves, m, COALESCED_MOVES);
+            irc_combine(irc, u, v);
+            irc_add_work_list(irc, u);
+        } else {
+            lists_move(&irc->moves, m, ACTIVE_MOVES);
+        }
+    }
+}
+
+static void irc_freeze_moves(IRC *irc, int u) {
+    for (int i = 0; i < irc->num_move_list[u]; i++) {
+        int m = irc->move_list[u][i];
+        if (!irc_pending_move(irc, m))
+            continue;
+        int x = irc_get_alias(irc, irc->move_ends[m][0]);
+        int y = irc_get_alias(irc, irc->move_ends[m][1]);
+        int v = y == irc_get_alias(irc, u) ? x : y;
+        lists_move(&irc->moves, m, FROZEN_MOVES);
+        if (irc->nodes.which[v] == FREEZE_WORKLIST && !irc_move_related(irc, v) &&
+            irc->degree[v] < irc->k)
+            lists_move(&irc->nodes, v, SIMPLIFY_WORKLIST);
+    }
+}
+
+static void irc_freeze(IRC *irc) {
+    int u = irc->nodes.head[FREEZE_WORKLIST];
+    lists_move(&irc->nodes, u, SIMPLIFY_WORKLIST);
+    irc_freeze_moves(irc, u);
+}
+
+/**
+ * @brief Pick the potential spill with the lowest weight / degree
+ *
+ * The degree is the one of the graph as built (including the edges added
+ * by merges), which keeps long live ranges cheap to spill even after most
+ * of their neighbors were simplified.
+ */
+static void irc_select_spill(IRC *irc) {
+    int sel = -1;
+    double min_cost = INFINITY;
+    for (int n = irc->nodes.head[SPILL_WORKLIST]; n >= 0; n = irc->nodes.next[n]) {
+        double cost = irc->weight[n] / irc->g->num_neighbors[n];
+        if (sel < 0 || cost < min_cost) {
+            min_cost = cost;
+            sel = n;
+        }
+    }
+    lists_move(&irc->nodes, sel, SIMPLIFY_WORKLIST);
+    irc_freeze_moves(irc, sel);
+}
+
+static void irc_assign_colors(IRC *irc) {
+    while (irc->nodes.head[SELECT_STACK] >= 0) {
+        int n = irc->nodes.head[SELECT_STACK];
+        unsigned long ok_colors = (1ul << irc->k) - 1;
+
+        for (int i = 0; i < irc->g->num_neighbors[n]; i++) {
+            int w = irc_get_alias(irc, irc->g->adj_list[n][i]);
+            int list = irc->nodes.which[w];
+            if (list == COLORED_NODES || list == PRECOLORED)
+                ok_colors &= ~(1ul << irc->color[w]);
+        }
+
+        if (ok_colors == 0) {
+            lists_move(&irc->nodes, n, SPILLED_NODES);
+        } else {
+            lists_move(&irc->nodes, n, COLORED_NODES);
+            irc->color[n] = __builtin_ctzl(ok_colors);
+        }
+    }
+
+    for (int n = irc->nodes.head[COALESCED_NODES]; n >= 0; n = irc->nodes.next[n])
+        irc->color[n] = irc->color[irc_get_alias(irc, n)];
+}
+
+/**
+ * @brief Color the interference graph with iterated register coalescing
+ *
+ * Appel and George's algorithm: simplify removes low-degree nodes not
+ * related to moves, coalesce merges the operands of moves that pass the
+ * Briggs test (or the George test against a precolored register), freeze
+ * gives up on the moves of a low-degree node so it can be simplified, and
+ * potential spills pick the cheapest high-degree node. The phases are
+ * interleaved until the graph is empty, then colors are assigned in the
+ * reverse removal order and the nodes without a color become actual spills.
+ *
+ * The moves whose operands end up with the same color are left in the IR,
+ * to be deleted once the colors are final.
+ *
+ * @param g Interference graph (edges are added as nodes merge)
+ * @param ft Register numbering of the function
+ * @param weight Spill weight of each virtual register
+ * @param spilled Output array flagging the virtual registers to spill
+ * @return Array mapping local register IDs to assigned colors
+ */
+static int *iterated_coalescing(InterferenceGraph *g, const FunctionTemps *ft,
+                                const double *weight, bool *spilled) {
+    int num_temps = ft->num_temps, num_nodes = g->num_nodes;
+    IRC irc = {.g = g, .num_temps = num_temps, .k = ft->num_colors, .weight = weight};
+    lists_init(&irc.nodes, num_nodes, NUM_NODE_LISTS);
+    irc.degree = (int *)malloc(num_nodes * sizeof(int));
+    irc.alias = (int *)malloc(num_nodes * sizeof(int));
+    irc.color = (int *)calloc(num_nodes, sizeof(int));
+    irc.move_list = (int **)calloc(num_nodes, sizeof(int *));
+    irc.num_move_list = (int *)calloc(num_nodes, sizeof(int));
+    irc.cap_move_list = (int *)calloc(num_nodes, sizeof(int));
+
+    for (int n = 0; n < num_nodes; n++) {
+        irc.alias[n] = n;
+        irc.degree[n] = g->num_neighbors[n];
+    }
+    for (int n = num_temps; n < num_nodes; n++) {
+        lists_move(&irc.nodes, n, PRECOLORED);
+        irc.color[n] = n - num_temps;
+        irc.degree[n] = INT_MAX;
+    }
+
+    // moves between allocatable registers
+    int capacity = 16;
+    irc.num_moves = 0;
+    irc.move_ends = malloc(capacity * sizeof(*irc.move_ends));
+    for (IRNode *node = ft->fn->entry; node != ft->fn->exit; node = node->next) {
+        int dest = node->instruction == MOV ? local_id(ft, node->dest) : -1;
+        int src = node->instruction == MOV ? local_id(ft, node->src1) : -1;
+        if (dest < 0 || src < 0 || dest == src || (dest >= num_temps && src >= num_temps))
+            continue;
+        if (irc.num_moves == capacity) {
+            capacity *= 2;
+            irc.move_ends = realloc(irc.move_ends, capacity * sizeof(*irc.move_ends));
+        }
+        irc.move_ends[irc.num_moves][0] = dest;
+        irc.move_ends[irc.num_moves][1] = src;
+        irc_add_move(&irc, dest, irc.num_moves);
+        irc_add_move(&irc, src, irc.num_moves);
+        irc.num_moves++;
+    }
+    lists_init(&irc.moves, irc.num_moves, NUM_MOVE_LISTS);
+    for (int m = 0; m < irc.num_moves; m++)
+        lists_move(&irc.moves, m, WORKLIST_MOVES);
+
+    for (int n = 0; n < num_temps; n++) {
+        if (irc.degree[n] >= irc.k)
+            lists_move(&irc.nodes, n, SPILL_WORKLIST);
+        else if (irc_move_related(&irc, n))
+            lists_move(&irc.nodes, n, FREEZE_WORKLIST);
+        else
+            lists_move(&irc.nodes, n, SIMPLIFY_WORKLIST);
+    }
+
+    while (true) {
+        if (irc.nodes.head[SIMPLIFY_WORKLIST] >= 0)
+            irc_simplify(&irc);
+        else if (irc.moves.head[WORKLIST_MOVES] >= 0)
+            irc_coalesce(&irc);
+        else if (irc.nodes.head[FREEZE_WORKLIST] >= 0)
+            irc_freeze(&irc);
+        else if (irc.nodes.head[SPILL_WORKLIST] >= 0)
+            irc_select_spill(&irc);
+        else
+            break;
+    }
+    irc_assign_colors(&irc);
+
+    int *map = (int *)malloc(num_temps * sizeof(int));
+    for (int n = 0; n < num_temps; n++) {
+        spilled[n] = irc.nodes.which[n] == SPILLED_NODES;
+        map[n] = irc.color[n];
+    }
+
+    for (int n = 0; n < num_nodes; n++)
+        free(irc.move_list[n]);
+    free(irc.move_list);
+    free(irc.num_move_list);
+    free(irc.cap_move_list);
+    free(irc.move_ends);
+    lists_free(&irc.moves);
+    lists_free(&irc.nodes);
+    free(irc.color);
+    free(irc.alias);
+    free(irc.degree);
+    return map;
+}
+
+/**
+ * @struct LiveRange
+ * @brief Range of positions `[from, to]` (inclusive) where a register is live
+ */
+typedef struct LiveRange {
+    int from, to;
+} LiveRange;
+
+/**
+ * @struct Interval
+ * @brief Live interval of a register for the linear-scan allocator
+ *
+ * Positions are derived from instruction addresses: the `p`-th instruction
+ * of the function reads its operands at `2p` and writes its results at
+ * `2p + 1`, so a register read by an instruction may share a physical
+ * register with the one it writes. Ranges are sorted by position. Virtual
+ * registers are allocated on the hull `[start, end]` of their ranges,
+ * while physical registers keep their holes (e.g. `a0` is only busy around
+ * calls, syscalls and returns).
+ */
+typedef struct Interval {
+    LiveRange *ranges;
+    int num_ranges;
+    int capacity;
+    int start, end;
+} Interval;
+
+/**
+ * @brief Add a range to an interval built backwards
+ *
+ * Intervals are built walking the function backwards, so the new range
+ * never starts after the earliest one, which is kept last in the array.
+ * Overlapping or adjacent ranges are merged.
+ */
+static void add_range(Interval *iv, int from, int to) {
+    if (iv->num_ranges > 0) {
+        LiveRange *first = &iv->ranges[iv->num_ranges - 1];
+        if (to + 1 >= first->from) {
+            first->from = from < first->from ? from : first->from;
+            first->to = to > first->to ? to : first->to;
+            return;
+        }
+    }
+
+    if (iv->num_ranges == iv->capacity) {
+        iv->capacity = iv->capacity == 0 ? 4 : 2 * iv->capacity;
+        iv->ranges = (LiveRange *)realloc(iv->ranges, iv->capacity * sizeof(LiveRange));
+    }
+    iv->ranges[iv->num_ranges++] = (LiveRange){from, to};
+}
+
+/**
+ * @brief Position of an instruction inside its function
+ */
+static inline int position(const IRFunction *fn, const IRNode *node) {
+    return (node->address - fn->entry->address) / 4;
+}
+
+/**
+ * @brief First and last instructions of a block, comments aside (comments
+ *        have no address)
+ *
+ * @return false if the block only holds comments
+ */
+static bool code_bounds(const BasicBlock *b, const IRNode **first, const IRNode **last) {
+    *first = b->first;
+    while (*first != b->last && (*first)->instruction == COMMENT)
+        *first = (*first)->next;
+    *last = b->last;
+    while (*last != *first && (*last)->instruction == COMMENT)
+        *last = (*last)->prev;
+    return (*first)->instruction != COMMENT;
+}
+
+/**
+ * @brief Build the live intervals of the registers of a function
+ *
+ * Blocks are visited in reverse instruction order and each one is walked
+ * backwards from its live-out set: a register live at the block exit is
+ * live from the block start, a definition cuts the range opened by the
+ * later uses, and a use opens a range from the block start.
+ *
+ * @param ft Register numbering of the function (addresses must be up to date)
+ * @param cfg Control-flow graph of the function
+ * @return Array indexed by node with the interval of each register
+ */
+static Interval *build_intervals(const FunctionTemps *ft, CFG *cfg) {
+    IRFunction *fn = ft->fn;
+    int num_nodes = ft->num_temps + ft->num_colors;
+    Interval *iv = (Interval *)calloc(num_nodes, sizeof(Interval));
+    cfg_liveness(cfg, ft->local, num_nodes);
+
+    int regs[NUM_REGISTERS];
+    BitSet *live = new_bitset(num_nodes);
+    for (int i = cfg->num_blocks - 1; i >= 0; i--) {
+        BasicBlock *b = &cfg->blocks[i];
+        const IRNode *first, *last;
+        if (!code_bounds(b, &first, &last))
+            continue;
+        int from = 2 * position(fn, first);
+        int to = 2 * position(fn, last) + 1;
+        bitset_assign(live, b->live_out);
+        BITSET_FOREACH(j, live) {
+            add_range(&iv[j], from, to);
+        }
+
+        for (IRNode *node = b->last; node != b->first->prev; node = node->prev) {
+            if (node->instruction == COMMENT)
+                continue;
+            int p = position(fn, node);
+
+            int n = ir_defs(node, regs);
+            for (int k = 0; k < n; k++) {
+                int d = local_id(ft, regs[k]);
+                if (d < 0)
+                    continue;
+                if (bitset_test(live, d))
+                    iv[d].ranges[iv[d].num_ranges - 1].from = 2 * p + 1;
+                else
+                    add_range(&iv[d], 2 * p + 1, 2 * p + 1);
+                bitset_clear(live, d);
+            }
+
+            n = ir_uses(node, regs);
+            for (int k = 0; k < n; k++) {
+                int u = local_id(ft, regs[k]);
+                if (u < 0)
+                    continue;
+                add_range(&iv[u], from, 2 * p);
+                bitset_set(live, u);
+            }
+        }
+    }
+    destroy_biset(live);
+
+    // ranges were collected backwards
+    for (int i = 0; i < num_nodes; i++) {
+        for (int l = 0, r = iv[i].num_ranges - 1; l < r; l++, r--) {
+            LiveRange tmp = iv[i].ranges[l];
+            iv[i].ranges[l] = iv[i].ranges[r];
+            iv[i].ranges[r] = tmp;
+        }
+        if (iv[i].num_ranges > 0) {
+            iv[i].start = iv[i].ranges[0].from;
+            iv[i].end = iv[i].ranges[iv[i].num_ranges - 1].to;
+        }
+    }
+
+    return iv;
+}
+
+/**
+ * @brief Free the intervals built by `build_intervals`
+ */
+static void destroy_intervals(Interval *iv, int num_nodes) {
+    for (int i = 0; i < num_nodes; i++)
+        free(iv[i].ranges);
+    free(iv);
+}
+
+/**
+ * @brief Start position of the interval of a node, the sort key of linear scan
+ */
+typedef struct IntervalStart {
+    int start, node;
+} IntervalStart;
+
+static int compare_start(const void *a, const void *b) {
+    const IntervalStart *x = (const IntervalStart *)a, *y = (const IntervalStart *)b;
+    return x->start != y->start ? x->start - y->start : x->node - y->node;
+}
+
+/**
+ * @brief Check if a physical register is busy somewhere in `[start, end]`
+ *
+ * Intervals are visited by increasing start, so `cursor` only moves forward
+ * over the ranges of the register that end before the current start.
+ */
+static bool fixed_conflict(const Interval *fixed, int *cursor, int start, int end) {
+    while (*cursor < fixed->num_ranges && fixed->ranges[*cursor].to < start)
+        (*cursor)++;
+    return *cursor < fixed->num_ranges && fixed->ranges[*cursor].from <= end;
+}
+
+/**
+ * @brief Assign registers with linear scan (Poletto and Sarkar)
+ *
+ * Visits the virtual registers by increasing interval start, expiring the
+ * intervals that ended, and gives each one the first free register, in
+ * `register_file` order, that is not busy as a physical register anywhere
+ * in the interval (so values live across a call avoid the caller-saved
+ * registers). When none is free, the interval that ends last among the
+ * current one and the active ones that could hand over their register is
+ * spilled. Spilled registers are split at their uses by the spill code,
+ * each piece getting an interval of its own in the next round.
+ *
+ * @param ft Register numbering of the function
+ * @param cfg Control-flow graph of the function
+ * @param weight Spill weight of each virtual register, infinite when it
+ *               must not be spilled
+ * @param spilled Output array flagging the virtual registers to spill
+ * @return Array mapping local register IDs to assigned colors
+ */
+static int *linear_scan(const FunctionTemps *ft, CFG *cfg, const double *weight, bool *spilled) {
+    int num_temps = ft->num_temps, num_colors = ft->num_colors;
+    Interval *iv = build_intervals(ft, cfg);
+
+    IntervalStart *order = (IntervalStart *)malloc(num_temps * sizeof(IntervalStart));
+    int *map = (int *)malloc(num_temps * sizeof(int));
+    for (int i = 0; i < num_temps; i++) {
+        order[i] = (IntervalStart){iv[i].start, i};
+        map[i] = 0;
+        spilled[i] = false;
+    }
+    qsort(order, num_temps, sizeof(IntervalStart), compare_start);
+
+    int owner[NUM_ALLOCATABLE], cursor[NUM_ALLOCATABLE];
+    for (int c = 0; c < num_colors; c++) {
+        owner[c] = -1;
+        cursor[c] = 0;
+    }
+
+    for (int k = 0; k < num_temps; k++) {
+        int v = order[k].node;
+        int start = iv[v].start, end = iv[v].end;
+
+        // expire the intervals that ended, then look for a free register
+        int color = -1, victim = -1;
+        for (int c = 0; c < num_colors; c++) {
+            if (owner[c] >= 0 && iv[owner[c]].end < start)
+                owner[c] = -1;
+            if (fixed_conflict(&iv[num_temps + c], &cursor[c], start, end))
+                continue;
+            if (owner[c] < 0 && color < 0)
+                color = c;
+            else if (owner[c] >= 0 && weight[owner[c]] != INFINITY &&
+                     (victim < 0 || iv[owner[c]].end > iv[owner[victim]].end))
+                victim = c;
+        }
+
+        if (color < 0 && victim >= 0 &&
+            (iv[owner[victim]].end > end || weight[v] == INFINITY)) {
+            spilled[owner[victim]] = true;
+            color = victim;
+        }
+        if (color < 0) {
+            spilled[v] = true;
+            continue;
+        }
+        owner[color] = v;
+        map[v] = color;
+    }
+
+    free(order);
+    destroy_intervals(iv, num_temps + num_colors);
+    return map;
+}
+
+/**
+ * @brief Create a load from a spill slot: rd ← mem[offset + fp]
+ */
+static IRNode *new_spill_load(int dest, int offset) {
+    IRNode *node = new_ir_node(LOAD);
+    node->dest = dest;
+    node->src_kind = REG_SRC;
+    node->src1 = FP_REGISTER;
+    node->imm = offset;
+    return node;
+}
+
+/**
+ * @brief Create a store to a spill slot: mem[offset + fp] ← rs2
+ */
+static IRNode *new_spill_store(int src, int offset) {
+    IRNode *node = new_ir_node(STORE);
+    node->src_kind = REG_SRC;
+    node->src2 = src;
+    node->src1 = FP_REGISTER;
+    node->imm = offset;
+    return node;
+}
+
+/**
+ * @brief Copy a constant load, writing a new register
+ */
+static IRNode *new_remat(const IRNode *def, int dest) {
+    IRNode *node = new_ir_node(def->instruction);
+    node->dest = dest;
+    node->src_kind = def->src_kind;
+    node->src1 = def->src1;
+    node->imm = def->imm;
+    return node;
+}
+
+/**
+ * @brief Rewrite a function so that spilled registers live in its frame
+ *
+ * Each spilled virtual register gets a slot in the frame of the function.
+ * Every use is replaced by a fresh register loaded from the slot right
+ * before the instruction, and every definition by a fresh register stored
+ * to the slot right after it. The fresh registers have live ranges of a
+ * single instruction, so the next coloring round sees less pressure.
+ *
+ * Registers holding a constant are rematerialized instead: their
+ * definition is deleted and a copy of it is placed before each use, so
+ * they need neither a slot nor memory traffic.
+ *
+ * @param ir Pointer to IR structure
+ * @param ft Register numbering of the function
+ * @param spilled Array flagging, by local ID, the registers to spill
+ */
+static void rewrite_spills(IR *ir, const FunctionTemps *ft, bool *spilled) {
+    IRFunction *fn = ft->fn;
+    int *slot = (int *)calloc(ft->num_temps, sizeof(int));
+    int first_new = ir->next_temp_reg; // registers created here are not numbered
+
+    for (IRNode *node = fn->entry; node != fn->exit; node = node->next) {
+        int *operands[] = {&node->src1, &node->src2};
+        for (int i = 0; i < 2; i++) {
+            // `x * x` has both operands rewritten by the first reload
+            if (*operands[i] <= 0 || *operands[i] >= first_new)
+                continue;
+            int v = local_id(ft, *operands[i]);
+            if (!spilled[v])
+                continue;
+
+            int reg = ft->temps[v];
+            int reload = register_new_temp(ir);
+            if (ft->remat[v] != NULL) {
+                ir_insert_before(ir, node, new_remat(ft->remat[v], reload));
+            } else {
+                if (slot[v] == 0)
+                    slot[v] = ir_alloc_frame_slot(ir, fn);
+                ir_insert_before(ir, node, new_spill_load(reload, slot[v]));
+            }
+            // both operands may name the same register
+            if (node->src1 == reg)
+                node->src1 = reload;
+            if (node->src2 == reg)
+                node->src2 = reload;
+        }
+
+        int v = local_id(ft, node->dest);
+        if (node->dest > 0 && spilled[v] && ft->remat[v] == NULL) {
+            if (slot[v] == 0)
+                slot[v] = ir_alloc_frame_slot(ir, fn);
+
+            int value = register_new_temp(ir);
+            node->dest = value;
+            ir_insert_after(ir, node, new_spill_store(value, slot[v]));
+            node = node->next;
+        }
+    }
+
+    // the uses are copied from the definitions, delete those last
+    for (int v = 0; v < ft->num_temps; v++) {
+        if (spilled[v] && ft->remat[v] != NULL)
+            ir_remove(ir, ft->remat[v]);
+    }
+
+    free(slot);
+}
+
+/**
+ * @brief Save the callee-saved registers used by a function
+ *
+ * Each used `s` register gets a frame slot, a store at the end of the
+ * prologue and a load at the start of the epilogue.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function to patch
+ * @param used Array flagging, by color, the registers used by the function
+ */
+static void save_callee_saved(IR *ir, IRFunction *fn, const bool *used) {
+    for (int color = 0; color < RegisterBudget; color++) {
+        if (!used[color] || register_file[color].cls != CALLEE_SAVED)
+            continue;
+
+        int reg = register_file[color].reg;
+        int slot = ir_alloc_frame_slot(ir, fn);
+        IRNode *save = new_spill_store(reg, slot);
+        ir_insert_after(ir, fn->prologue, save);
+        fn->prologue = save;
+        ir_insert_after(ir, fn->epilogue, new_spill_load(reg, slot));
+    }
+}
+
+/**
+ * @brief Delete the moves whose operands got the same physical register
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function to clean up
+ * @param color_map Map from virtual register ID to physical register
+ */
+static void remove_redundant_moves(IR *ir, IRFunction *fn, const int *color_map) {
+    for (IRNode *node = fn->entry; node != fn->exit;) {
+        IRNode *next = node->next;
+        if (node->instruction == MOV) {
+            int dest = node->dest > 0 ? color_map[node->dest] : node->dest;
+            int src = node->src1 > 0 ? color_map[node->src1] : node->src1;
+            if (dest == src)
+                ir_remove(ir, node);
+        }
+        node = next;
+    }
+}
+
+/**
+ * @brief Name of the selected register allocator, for reports
+ */
+static const char *allocator_name(void) {
+    switch (RegAllocator) {
+    case LINEAR_SCAN:
+        return "linear scan";
+    case ITERATED_COALESCING:
+        return "iterated coalescing";
+    default:
+        return "graph coloring";
+    }
+}
+
+/**
+ * @brief Report the registers spilled in one allocation round (`--ra-stats`)
+ *
+ * Lists every spilled register with its number of accesses, the deepest
+ * loop holding one of them, its loop-weighted spill weight and, for the
+ * graph allocators, its degree and the cost (weight / degree) the spill
+ * heuristic minimizes. Linear scan spills the interval that ends last
+ * instead, so only the weight is shown.
+ *
+ * @param ft Register numbering of the function
+ * @param weight Spill weight of each register
+ * @param degree Degree of each node in the interference graph, or NULL
+ * @param spilled Array flagging, by local ID, the spilled registers
+ * @param round Number of the round, from 1
+ */
+static void report_spills(const FunctionTemps *ft, const double *weight, const int *degree,
+                          const bool *spilled, int round) {
+    int *accesses = (int *)calloc(ft->num_temps, sizeof(int));
+    int *depth = (int *)calloc(ft->num_temps, sizeof(int));
+    int num_spilled = 0;
+
+    for (IRNode *node = ft->fn->entry; node != ft->fn->exit->next; node = node->next) {
+        int regs[] = {node->dest, node->src1, node->src2};
+        for (int i = 0; i < 3; i++) {
+            if (regs[i] <= 0)
+                continue;
+            int v = ft->local[regs[i]];
+            accesses[v]++;
+            if (node->block->loop_depth > depth[v])
+                depth[v] = node->block->loop_depth;
+        }
+    }
+    for (int i = 0; i < ft->num_temps; i++)
+        num_spilled += spilled[i];
+
+    fprintf(listing, "  round %d: %d of %d registers spilled\n", round, num_spilled,
+            ft->num_temps);
+    for (int i = 0; i < ft->num_temps; i++) {
+        if (!spilled[i])
+            continue;
+        fprintf(listing, "    t%d: %d accesses, loop depth %d, weight %g", ft->temps[i],
+                accesses[i], depth[i], weight[i]);
+        if (degree != NULL)
+            fprintf(listing, ", degree %d, cost %g", degree[i],
+                    weight[i] / (degree[i] > 0 ? degree[i] : 1));
+        fprintf(listing, "%s\n", ft->remat[i] != NULL ? " (rematerialized)" : "");
+    }
+
+    free(depth);
+    free(accesses);
+}
+
+/**
+ * @brief Allocate the registers of a single function
+ *
+ * Colors the interference graph of the function (with or without iterated
+ * coalescing) or runs linear scan on its live intervals, spilling and
+ * starting over until every register gets a color, deletes the moves that
+ * became no-ops, stores the chosen physical registers
+ * in `color_map` and saves the callee-saved ones the function uses.
+ * Spill weights count every access 10^depth times, depth being its loop
+ * nesting depth, so values used in loops are the last to be spilled. With
+ * `RegAllocStats` each round is reported to the listing.
+ *
+ * @param ir Pointer to IR structure (spill code creates new registers)
+ * @param ft Register numbering of the function, `local` must be sized to
+ *           the current number of virtual registers
+ * @param first_unspillable First register ID created by spill code
+ * @param color_map Program-wide map from virtual register ID to register, grown
+ *                  to cover the registers created by spill code
+ */
+static void allocate_function(IR *ir, FunctionTemps *ft, int first_unspillable, int **color_map) {
+    int map_size = ir->next_temp_reg;
+    int frame_size = ft->fn->frame_size;
+    int round = 0, total_spilled = 0, total_remat = 0;
+
+    if (RegAllocStats)
+        fprintf(listing, "Register allocation of %s (%s, %d registers):\n", ft->fn->name,
+                allocator_name(), ft->num_colors);
+
+    while (true) {
+        number_temps(ft);
+        CFG *cfg = build_cfg(ft->fn);
+        cfg_loop_depth(cfg);
+        InterferenceGraph *g = NULL;
+        int *colors;
+        double *weight;
+        bool *spilled = (bool *)malloc(ft->num_temps * sizeof(bool));
+
+        if (RegAllocator == LINEAR_SCAN) {
+            weight = spill_weights(ft, first_unspillable);
+            colors = linear_scan(ft, cfg, weight, spilled);
+        } else if (RegAllocator == ITERATED_COALESCING) {
+            g = build_graph(ft, cfg);
+            weight = spill_weights(ft, first_unspillable);
+            colors = iterated_coalescing(g, ft, weight, spilled);
+        } else {
+            g = build_graph(ft, cfg);
+            // print_graph(g);
+
+            // coalescing renames registers, rebuild the graph on the new code
+            if (coalesce_moves(ir, ft, g, first_unspillable) > 0) {
+                destroy_graph(g);
+                free_cfg(cfg);
+                free(spilled);
+                release_temps(ft);
+                continue;
+            }
+
+            weight = spill_weights(ft, first_unspillable);
+            colors = color_graph(g, ft->num_temps, ft->num_colors, weight, spilled);
+        }
+
+        bool has_spills = false, fatal = false;
+        for (int i = 0; i < ft->num_temps; i++) {
+            has_spills = has_spills || spilled[i];
+            fatal = fatal || (spilled[i] && ft->temps[i] >= first_unspillable);
+            total_spilled += spilled[i];
+            total_remat += spilled[i] && ft->remat[i] != NULL;
+        }
+
+        round++;
+        if (RegAllocStats && has_spills)
+            report_spills(ft, weight, g != NULL ? g->num_neighbors : NULL, spilled, round);
+        free(weight);
+        destroy_graph(g);
+        free_cfg(cfg);
+
+        if (fatal) {
+            fprintf(listing,
+                    "\033[1;31mFatal Error\033[0m: %d registers are not enough, must spill\n",
+                    ft->num_colors);
+            Error = true;
+        }
+
+        if (!has_spills || fatal) {
+            if (ir->next_temp_reg > map_size)
+                *color_map = (int *)realloc(*color_map, ir->next_temp_reg * sizeof(int));
+            bool used[NUM_ALLOCATABLE] = {false};
+            for (int i = 0; i < ft->num_temps; i++) {
+                (*color_map)[ft->temps[i]] = register_file[colors[i]].reg;
+                used[colors[i]] = true;
+            }
+            if (RegAllocStats)
+                fprintf(listing,
+                        "  %d registers spilled in %d rounds (%d rematerialized), "
+                        "%d bytes of spill slots\n",
+                        total_spilled, round - 1, total_remat, ft->fn->frame_size - frame_size);
+            save_callee_saved(ir, ft->fn, used);
+            remove_redundant_moves(ir, ft->fn, *color_map);
+            free(colors);
+            free(spilled);
+            release_temps(ft);
+            return;
+        }
+
+        // spill, then rerun liveness and coloring on the rewritten code
+        free(colors);
+        int num_temps = ir->next_temp_reg;
+        rewrite_spills(ir, ft, spilled);
+        free(spilled);
+        release_temps(ft);
+        if (RegAllocator == LINEAR_SCAN)
+            ir_renumber(ir);
+
+        // the numbering table must cover the registers created by spill code
+        int *table = ft->local - NUM_REGISTERS;
+        table = (int *)realloc(table, (NUM_REGISTERS + ir->next_temp_reg) * sizeof(int));
+        ft->local = table + NUM_REGISTERS;
+        for (int i = num_temps; i < ir->next_temp_reg; i++)
+            ft->local[i] = -1;
+    }
+}
+
 int *allocate_registers(IR *ir) {
-    int num_temps = ir->next_temp_reg;
-    InterferenceGraph *g = build_graph(ir);
-    // print_graph(g);
-    int *color_map = color_graph(g, num_temps, K);
+    int first_unspillable = ir->next_temp_reg;
+
+    // physical registers have negative IDs, they sit before the virtual ones
+    FunctionTemps ft;
+    int *table = (int *)malloc((NUM_REGISTERS + ir->next_temp_reg) * sizeof(int));
+    for (int i = 0; i < NUM_REGISTERS + ir->next_temp_reg; i++)
+        table[i] = -1;
+    ft.local = table + NUM_REGISTERS;
+    ft.remat = NULL;
+    ft.num_colors = RegisterBudget;
 
-    // printf("Color map: ");
-    // for (int i = 0; i < num_temps; i++) {
-    //     printf("%d ", color_map[i]);
-    // }
-    // printf("\n");
+    // linear scan derives its intervals from the instruction addresses
+    if (RegAllocator == LINEAR_SCAN)
+        ir_renumber(ir);
 
-    destroy_graph(g);
+    // functions are allocated independently, spill code only grows the map
+    int *color_map = (int *)calloc(ir->next_temp_reg, sizeof(int));
+    for (IRFunction *fn = ir->functions; fn != NULL; fn = fn->next) {
+        ft.fn = fn;
+        allocate_function(ir, &ft, first_unspillable, &color_map);
+    }
 
+    free(ft.local - NUM_REGISTERS);
     return color_map;
 }
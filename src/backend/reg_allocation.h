@@ -4,40 +4,87 @@
 #include "../utils/ir.h"
 
 /**
- * @brief Number of available physical registers for allocation
+ * @enum RegisterClass
+ * @brief Calling-convention role of an allocatable register
+ */
+typedef enum RegisterClass {
+    CALLER_SAVED, /**< `t` registers, may be clobbered by any call */
+    ARGUMENT,     /**< `a` registers, also used by calls and syscalls */
+    CALLEE_SAVED  /**< `s` registers, saved by the prologue of the functions using them */
+} RegisterClass;
+
+/**
+ * @struct PhysicalRegister
+ * @brief Entry of the register file description used by the allocator
+ */
+typedef struct PhysicalRegister {
+    int reg;           /**< physical register ID (negative, as in ir.h) */
+    RegisterClass cls; /**< calling-convention class */
+} PhysicalRegister;
+
+/** @brief Number of registers the allocator may hand out */
+#define NUM_ALLOCATABLE 26
+
+/** @brief Smallest register budget that still fits the operands of any instruction */
+#define MIN_ALLOCATABLE 3
+
+/**
+ * @brief Allocatable registers in order of preference
  *
- * This constant defines how many physical registers are available for
- * the register allocator to use. If more virtual registers are needed
- * than this number allows, register spilling will be required.
+ * Colors are indices into this table. Caller-saved registers come first
+ * since they cost nothing to use, then the argument registers and finally
+ * the callee-saved ones, which need a save and a restore in the function.
+ * A budget of N registers (`--regs=N`) keeps the first N entries.
  */
-#define K 4
+extern const PhysicalRegister register_file[NUM_ALLOCATABLE];
 
 /**
  * @brief Allocate physical registers to virtual registers in IR
  *
  * Performs complete register allocation on the given intermediate representation
- * using graph coloring algorithm. The function:
+ * using graph coloring algorithm. No virtual register is live across a function
+ * boundary, so each function of the IR is allocated on its own, with bitsets
+ * and graphs sized to the registers it uses. For each function:
  *
- * 1. Analyzes register liveness throughout the program
+ * 1. Analyzes register liveness throughout the function
  * 2. Builds an interference graph showing which registers cannot share
  *    the same physical register due to overlapping lifetimes
- * 3. Colors the interference graph to assign physical register numbers
- * 4. Returns a mapping from virtual register IDs to physical register colors
+ * 3. Coalesces moves whose operands can share a register without making
+ *    the graph harder to color (Briggs/George tests), deleting them from
+ *    the IR, and goes back to step 1 while any move is removed
+ * 4. Colors the interference graph to assign physical register numbers
+ * 5. Spills the registers that could not be colored to stack slots in
+ *    function frame and repeats from step 1 until every register gets a color
+ *
+ * `RegAllocator` selects how steps 3 and 4 are done: the default runs the
+ * coalescing and coloring above one after the other, `ITERATED_COALESCING`
+ * interleaves them (Appel and George) with loop-weighted spill costs, and
+ * `LINEAR_SCAN` skips the graph altogether and assigns registers over live
+ * intervals, which is much faster on large inputs.
+ *
+ * Physical registers read or written by the code (e.g. `a0` around calls
+ * and syscalls) take part in the graph as precolored nodes. The callee-saved
+ * registers a function ends up using are saved in its prologue and restored
+ * in its epilogue.
  *
  * The returned mapping array is indexed by virtual register ID (1 to n)
- * and contains the assigned physical register color (0 to K-1).
+ * and contains the assigned physical register ID, taken from the first
+ * `RegisterBudget` entries of `register_file`.
  *
  * @param ir Pointer to IR structure containing virtual register usage
  * @return Array mapping virtual register IDs to physical register colors,
  *         or NULL on allocation failure. The caller is responsible for
  *         freeing this array when done.
  *
- * @note If register spilling is required (more than K registers needed
- *       simultaneously), the function will report a fatal error and set
- *       the global Error flag.
+ * @note Spilling inserts loads and stores around the uses and definitions
+ *       of the spilled registers and grows the frame of their functions.
+ *       Registers defined once by a constant load (`li`, `addi rd, x0, imm`)
+ *       are rematerialized instead: the load is repeated before each use.
+ *       Only if the registers created by spill code themselves cannot be
+ *       colored a fatal error is reported and the global Error flag is set.
  *
- * @warning The function modifies the IR by adding liveness analysis
- *          information (live_in and live_out bitsets) to each instruction node.
+ * @warning The function modifies the IR by inserting spill code and by
+ *          renaming coalesced registers and removing their moves.
  */
 int *allocate_registers(IR *ir);
 
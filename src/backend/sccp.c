@@ -0,0 +1,643 @@
+#include "sccp.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include "../utils/object_code.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @enum Level
+ * @brief Position of a register in the lattice, values only move down
+ */
+typedef enum Level {
+    UNDEFINED, /**< no definition evaluated yet */
+    CONSTANT,  /**< same value on every evaluation */
+    VARYING    /**< not known at compile time */
+} Level;
+
+typedef struct Value {
+    Level level;
+    int constant;
+} Value;
+
+/**
+ * @struct Propagation
+ * @brief State of the propagation over one function
+ *
+ * Every edge of the CFG has a slot in `taken`: the edge from `preds[j]` to
+ * block `b` is `taken[edge_base[b->id] + j]`. Blocks are queued when one of
+ * their incoming edges becomes executable, and registers when their value
+ * moves down, so their readers (found through `users`) are evaluated again.
+ */
+typedef struct Propagation {
+    CFG *cfg;
+    int num_regs; /**< size of `value`, registers created later are unknown */
+    Value *value; /**< register ID -> lattice value */
+
+    bool *reached;  /**< block ID -> an incoming edge is executable */
+    bool *taken;    /**< executable flag of every edge */
+    int *edge_base; /**< block ID -> slot of the edge from its first predecessor */
+
+    int *user_start; /**< register ID -> first index of its readers in `users` */
+    IRNode **users;  /**< instructions reading each register, bucketed by register */
+
+    int *blocks; /**< queued blocks, `2 * id + 1` when all instructions must be evaluated */
+    int num_blocks;
+    int *regs; /**< queued registers */
+    int num_regs_queued;
+    int regs_capacity;
+} Propagation;
+
+static bool is_branch(const IRNode *node) {
+    switch (node->instruction) {
+    case BEQ:
+    case BNE:
+    case BLE:
+    case BLT:
+    case BGE:
+    case BGT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static Value constant(int c) {
+    Value v = {CONSTANT, c};
+    return v;
+}
+
+static Value varying(void) {
+    Value v = {VARYING, 0};
+    return v;
+}
+
+/**
+ * @brief Greatest value below both arguments in the lattice
+ */
+static Value meet(Value a, Value b) {
+    if (a.level == UNDEFINED)
+        return b;
+    if (b.level == UNDEFINED)
+        return a;
+    if (a.level == CONSTANT && b.level == CONSTANT && a.constant == b.constant)
+        return a;
+    return varying();
+}
+
+/**
+ * @brief Value of a register operand; `x0` is zero, other physical
+ *        registers are unknown
+ */
+static Value operand(const Propagation *p, int reg) {
+    if (reg == X0_REGISTER)
+        return constant(0);
+    if (reg < 0 || reg >= p->num_regs)
+        return varying();
+    return p->value[reg];
+}
+
+static bool is_constant(const Propagation *p, int reg, int *c) {
+    Value v = operand(p, reg);
+    *c = v.constant;
+    return v.level == CONSTANT;
+}
+
+/**
+ * @brief Compute an operation on 32-bit registers as the processor does
+ *
+ * @return false for a division by zero or overflowing, left to run
+ */
+static bool fold(Instruction instruction, int a, int b, int *result) {
+    uint32_t x = (uint32_t)a, y = (uint32_t)b;
+    switch (instruction) {
+    case ADD:
+        *result = (int)(x + y);
+        return true;
+    case SUB:
+        *result = (int)(x - y);
+        return true;
+    case MUL:
+        *result = (int)(x * y);
+        return true;
+    case DIV:
+        if (b == 0 || (a == INT_MIN && b == -1))
+            return false;
+        *result = a / b;
+        return true;
+    case REM:
+        if (b == 0 || (a == INT_MIN && b == -1))
+            return false;
+        *result = a % b;
+        return true;
+    case SLL:
+        *result = (int)(x << (y & 31));
+        return true;
+    case SRL:
+        *result = (int)(x >> (y & 31));
+        return true;
+    case SRA:
+        *result = a >> (b & 31);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool branch_taken(Instruction instruction, int a, int b) {
+    switch (instruction) {
+    case BEQ:
+        return a == b;
+    case BNE:
+        return a != b;
+    case BLT:
+        return a < b;
+    case BGE:
+        return a >= b;
+    case BLE:
+        return a <= b;
+    default:
+        return a > b;
+    }
+}
+
+/**
+ * @brief Value written by a non-phi instruction
+ */
+static Value evaluate(const Propagation *p, const IRNode *node) {
+    switch (node->instruction) {
+    case LI:
+        return constant((int)node->imm);
+    case LUI:
+        return constant((int)((uint32_t)node->imm << 12));
+    case MOV:
+        return operand(p, node->src1);
+    case ADD:
+    case SUB:
+    case MUL:
+    case DIV:
+    case REM:
+    case SLL:
+    case SRA:
+    case SRL: {
+        Value a = operand(p, node->src1);
+        Value b = node->src_kind == CONST_SRC ? constant((int)node->imm) : operand(p, node->src2);
+        if (node->instruction == MUL && ((a.level == CONSTANT && a.constant == 0) ||
+                                         (b.level == CONSTANT && b.constant == 0)))
+            return constant(0);
+        if (a.level == VARYING || b.level == VARYING)
+            return varying();
+        if (a.level == UNDEFINED || b.level == UNDEFINED)
+            return a.level == UNDEFINED ? a : b;
+
+        int result;
+        return fold(node->instruction, a.constant, b.constant, &result) ? constant(result)
+                                                                        : varying();
+    }
+    default:
+        return varying();
+    }
+}
+
+/**
+ * @brief Slot in `taken` of the `k`-th outgoing edge of a block
+ *
+ * A branch to the block it falls through to has two edges to it, listed
+ * twice in its predecessors (taken edge first, like in `succ`).
+ */
+static int edge_slot(const Propagation *p, const BasicBlock *from, int k) {
+    BasicBlock *s = from->succ[k];
+    int skip = k == 1 && from->succ[0] == s;
+    for (int j = 0; j < s->num_preds; j++) {
+        if (s->preds[j] == from && skip-- == 0)
+            return p->edge_base[s->id] + j;
+    }
+    return -1;
+}
+
+static void mark_edge(Propagation *p, const BasicBlock *from, int k) {
+    int slot = edge_slot(p, from, k);
+    if (p->taken[slot])
+        return;
+    p->taken[slot] = true;
+
+    // the first edge evaluates the whole block, the next ones only its phis
+    BasicBlock *s = from->succ[k];
+    p->blocks[p->num_blocks++] = 2 * s->id + !p->reached[s->id];
+    p->reached[s->id] = true;
+}
+
+/**
+ * @brief Mark the outgoing edges of a block that can be executed
+ *
+ * A branch whose operands are not all known yet keeps both edges, as
+ * operands only stay undefined here when a register is read without a
+ * definition on some path (an uninitialized variable).
+ */
+static void visit_edges(Propagation *p, const BasicBlock *b) {
+    IRNode *term = block_terminator(b);
+    if (term != NULL && term->instruction == JUMP_REG)
+        return;
+
+    int a, c;
+    if (term != NULL && is_branch(term) && is_constant(p, term->src1, &a) &&
+        is_constant(p, term->src2, &c)) {
+        int k = branch_taken(term->instruction, a, c) ? 0 : 1;
+        if (k < b->num_succs)
+            mark_edge(p, b, k);
+        return;
+    }
+
+    for (int k = 0; k < b->num_succs; k++)
+        mark_edge(p, b, k);
+}
+
+static void lower(Propagation *p, int reg, Value v) {
+    if (reg <= 0 || reg >= p->num_regs)
+        return;
+
+    Value old = p->value[reg];
+    v = meet(old, v);
+    if (v.level == old.level && v.constant == old.constant)
+        return;
+    p->value[reg] = v;
+
+    if (p->num_regs_queued == p->regs_capacity) {
+        p->regs_capacity *= 2;
+        p->regs = (int *)realloc(p->regs, p->regs_capacity * sizeof(int));
+    }
+    p->regs[p->num_regs_queued++] = reg;
+}
+
+static void visit_phi(Propagation *p, const IRNode *phi) {
+    const BasicBlock *b = phi->block;
+    Value v = {UNDEFINED, 0};
+    for (int j = 0; j < phi->num_args; j++) {
+        if (p->taken[p->edge_base[b->id] + j])
+            v = meet(v, operand(p, phi->args[j]));
+    }
+    lower(p, phi->dest, v);
+}
+
+static void visit(Propagation *p, const IRNode *node) {
+    if (node->instruction == PHI)
+        visit_phi(p, node);
+    else if (is_branch(node))
+        visit_edges(p, node->block);
+    else if (node->dest > 0)
+        lower(p, node->dest, evaluate(p, node));
+}
+
+/**
+ * @brief Bucket the instructions of the function by the registers they read
+ */
+static void find_users(Propagation *p, IRFunction *fn) {
+    int *count = (int *)calloc(p->num_regs + 1, sizeof(int));
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        int operands[] = {node->src1, node->src2};
+        for (int i = 0; i < 2; i++) {
+            if (operands[i] > 0 && operands[i] < p->num_regs)
+                count[operands[i] + 1]++;
+        }
+        for (int i = 0; i < node->num_args; i++) {
+            if (node->args[i] > 0 && node->args[i] < p->num_regs)
+                count[node->args[i] + 1]++;
+        }
+    }
+
+    for (int reg = 0; reg < p->num_regs; reg++)
+        count[reg + 1] += count[reg];
+    p->user_start = count;
+    p->users = (IRNode **)malloc((count[p->num_regs] + 1) * sizeof(IRNode *));
+
+    int *fill = (int *)malloc(p->num_regs * sizeof(int));
+    for (int reg = 0; reg < p->num_regs; reg++)
+        fill[reg] = count[reg];
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        int operands[] = {node->src1, node->src2};
+        for (int i = 0; i < 2; i++) {
+            if (operands[i] > 0 && operands[i] < p->num_regs)
+                p->users[fill[operands[i]]++] = node;
+        }
+        for (int i = 0; i < node->num_args; i++) {
+            if (node->args[i] > 0 && node->args[i] < p->num_regs)
+                p->users[fill[node->args[i]]++] = node;
+        }
+    }
+    free(fill);
+}
+
+/**
+ * @brief Run both worklists until no value or edge changes
+ */
+static void propagate(Propagation *p) {
+    BasicBlock *entry = p->cfg->rpo[0];
+    p->reached[entry->id] = true;
+    p->blocks[p->num_blocks++] = 2 * entry->id + 1;
+
+    while (p->num_blocks > 0 || p->num_regs_queued > 0) {
+        while (p->num_blocks > 0) {
+            int item = p->blocks[--p->num_blocks];
+            BasicBlock *b = &p->cfg->blocks[item / 2];
+            for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+                if (item % 2 == 1 || node->instruction == PHI)
+                    visit(p, node);
+            }
+            // blocks ending in a jump or falling through are handled here
+            if (item % 2 == 1)
+                visit_edges(p, b);
+        }
+
+        while (p->num_regs_queued > 0) {
+            int reg = p->regs[--p->num_regs_queued];
+            for (int i = p->user_start[reg]; i < p->user_start[reg + 1]; i++) {
+                IRNode *node = p->users[i];
+                if (p->reached[node->block->id])
+                    visit(p, node);
+            }
+        }
+    }
+}
+
+static void make_li(IRNode *node, int c) {
+    node->instruction = LI;
+    node->src_kind = CONST_SRC;
+    node->src1 = 0;
+    node->src2 = 0;
+    node->imm = c;
+}
+
+static void make_immediate(IRNode *node, Instruction instruction, int src1, int imm) {
+    node->instruction = instruction;
+    node->src_kind = CONST_SRC;
+    node->src1 = src1;
+    node->src2 = 0;
+    node->imm = imm;
+}
+
+/**
+ * @brief Exponent of a power of two greater than one, -1 otherwise
+ */
+static int log2_exact(int c) {
+    if (c <= 1 || (c & (c - 1)) != 0)
+        return -1;
+    int k = 0;
+    while ((1 << k) != c)
+        k++;
+    return k;
+}
+
+/**
+ * @brief Fold the constant operands of an instruction whose result varies
+ */
+static void fold_operands(const Propagation *p, IRNode *node) {
+    int c;
+    if (node->src_kind == REG_SRC) {
+        switch (node->instruction) {
+        case ADD:
+            if (is_constant(p, node->src2, &c) && ir_fits_immediate(c))
+                make_immediate(node, ADD, node->src1, c);
+            else if (is_constant(p, node->src1, &c) && ir_fits_immediate(c))
+                make_immediate(node, ADD, node->src2, c);
+            break;
+        case SUB:
+            if (is_constant(p, node->src2, &c) && ir_fits_immediate(-(long)c))
+                make_immediate(node, ADD, node->src1, -c);
+            break;
+        case MUL: {
+            int other = node->src1;
+            if (!is_constant(p, node->src2, &c)) {
+                other = node->src2;
+                if (!is_constant(p, node->src1, &c))
+                    break;
+            }
+            if (c == 1) {
+                node->instruction = MOV;
+                node->src1 = other;
+                node->src2 = 0;
+            } else if (c == -1) {
+                node->instruction = SUB;
+                node->src1 = X0_REGISTER;
+                node->src2 = other;
+            } else if (log2_exact(c) > 0) {
+                make_immediate(node, SLL, other, log2_exact(c));
+            }
+            break;
+        }
+        case SLL:
+        case SRA:
+        case SRL:
+            if (is_constant(p, node->src2, &c))
+                make_immediate(node, node->instruction, node->src1, c & 31);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (node->instruction == ADD && node->src_kind == CONST_SRC && node->imm == 0 &&
+        node->dest != 0) {
+        node->instruction = MOV;
+        node->src_kind = REG_SRC;
+    }
+
+    // whatever stays in a register and is zero can read x0
+    if (is_constant(p, node->src1, &c) && c == 0)
+        node->src1 = X0_REGISTER;
+    if (node->src_kind == REG_SRC && is_constant(p, node->src2, &c) && c == 0)
+        node->src2 = X0_REGISTER;
+}
+
+/**
+ * @brief Replace a constant phi by an `li` placed after the phis and the
+ *        label of its block
+ */
+static void replace_phi(IR *ir, IRNode *phi, int c) {
+    BasicBlock *b = phi->block;
+    IRNode *pos = phi;
+    while (pos != b->last && (pos->next->instruction == PHI || pos->next->instruction == LABEL ||
+                              pos->next->instruction == COMMENT))
+        pos = pos->next;
+
+    IRNode *li = new_ir_node(LI);
+    li->dest = phi->dest;
+    make_li(li, c);
+    li->block = b;
+    ir_insert_after(ir, pos, li);
+    if (pos == b->last)
+        b->last = li;
+    if (phi == b->first)
+        b->first = phi->next;
+    ir_remove(ir, phi);
+}
+
+/**
+ * @brief Rewrite a reachable block with the values found
+ */
+static void rewrite_block(IR *ir, const Propagation *p, BasicBlock *b, IRNode **resolved,
+                          int *num_resolved) {
+    // phis first, while the block boundaries are those of the CFG
+    for (IRNode *node = b->first, *next; node != b->last->next; node = next) {
+        next = node->next;
+        if (node->instruction != PHI)
+            continue;
+
+        int c;
+        if (is_constant(p, node->dest, &c)) {
+            replace_phi(ir, node, c);
+            continue;
+        }
+
+        // keep the operands of the edges that remain
+        int n = 0;
+        for (int j = 0; j < node->num_args; j++) {
+            if (p->taken[p->edge_base[b->id] + j])
+                node->args[n++] = node->args[j];
+        }
+        node->num_args = n;
+    }
+
+    IRNode *end = b->last->next;
+    for (IRNode *node = b->first, *next; node != end; node = next) {
+        next = node->next;
+        int a, c;
+        if (node->instruction == PHI || node->instruction == LABEL || node->instruction == COMMENT)
+            continue;
+
+        if (is_branch(node)) {
+            if (!is_constant(p, node->src1, &a) || !is_constant(p, node->src2, &c)) {
+                fold_operands(p, node);
+            } else if (branch_taken(node->instruction, a, c)) {
+                node->instruction = JUMP;
+                node->src1 = 0;
+                node->src2 = 0;
+                resolved[(*num_resolved)++] = node;
+            } else {
+                ir_remove(ir, node);
+            }
+            continue;
+        }
+
+        if (node->instruction != LI && node->dest != 0 && is_constant(p, node->dest, &c)) {
+            make_li(node, c);
+        } else if (node->instruction == MOV && node->dest < 0 && is_constant(p, node->src1, &c)) {
+            make_li(node, c); // e.g. a constant argument or return value
+        } else {
+            fold_operands(p, node);
+        }
+    }
+}
+
+/**
+ * @brief Remove a jump made from a branch when only comments separate it
+ *        from its target
+ *
+ * The block then falls through to the same block, so the edge and its phi
+ * operands stay the same. Jumps over a label are kept, as removing them
+ * would make the code reach the label's block first.
+ */
+static void remove_jump_to_next(IR *ir, IRNode *jump) {
+    IRNode *node = jump->next;
+    while (node != jump->target && node->instruction == COMMENT)
+        node = node->next;
+    if (node == jump->target)
+        ir_remove(ir, jump);
+}
+
+/**
+ * @brief Remove the `li` of constants that are no longer read
+ */
+static void remove_dead_constants(IR *ir, const Propagation *p, IRFunction *fn) {
+    int *uses = (int *)calloc(p->num_regs, sizeof(int));
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        int operands[] = {node->src1, node->src2};
+        for (int i = 0; i < 2; i++) {
+            if (operands[i] > 0 && operands[i] < p->num_regs)
+                uses[operands[i]]++;
+        }
+        for (int i = 0; i < node->num_args; i++) {
+            if (node->args[i] > 0 && node->args[i] < p->num_regs)
+                uses[node->args[i]]++;
+        }
+    }
+
+    for (IRNode *node = fn->entry->next, *next; node != fn->exit; node = next) {
+        next = node->next;
+        int c;
+        if (node->instruction == LI && node->dest > 0 && node->dest < p->num_regs &&
+            uses[node->dest] == 0 && is_constant(p, node->dest, &c))
+            ir_remove(ir, node);
+    }
+
+    free(uses);
+}
+
+void propagate_constants(IR *ir, IRFunction *fn) {
+    Propagation p = {0};
+    p.cfg = build_cfg(fn);
+    p.num_regs = ir->next_temp_reg;
+    int n = p.cfg->num_blocks;
+
+    // registers not in SSA form (never written, e.g. an uninitialized variable) vary
+    int *num_defs = (int *)calloc(p.num_regs, sizeof(int));
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        if (node->dest > 0)
+            num_defs[node->dest]++;
+    }
+    p.value = (Value *)malloc(p.num_regs * sizeof(Value));
+    for (int reg = 0; reg < p.num_regs; reg++) {
+        p.value[reg].level = num_defs[reg] == 1 ? UNDEFINED : VARYING;
+        p.value[reg].constant = 0;
+    }
+    free(num_defs);
+
+    p.reached = (bool *)calloc(n, sizeof(bool));
+    p.edge_base = (int *)malloc((n + 1) * sizeof(int));
+    p.edge_base[0] = 0;
+    for (int i = 0; i < n; i++)
+        p.edge_base[i + 1] = p.edge_base[i] + p.cfg->blocks[i].num_preds;
+    p.taken = (bool *)calloc(p.edge_base[n] + 1, sizeof(bool));
+    p.blocks = (int *)malloc((p.edge_base[n] + 1) * sizeof(int));
+    p.regs_capacity = 16;
+    p.regs = (int *)malloc(p.regs_capacity * sizeof(int));
+    find_users(&p, fn);
+
+    propagate(&p);
+
+    // the epilogue is kept even when never reached (the function loops forever)
+    BasicBlock *epilogue = fn->epilogue->block;
+    IRNode **resolved = (IRNode **)malloc(n * sizeof(IRNode *));
+    int num_resolved = 0;
+    for (int i = 0; i < n; i++) {
+        BasicBlock *b = &p.cfg->blocks[i];
+        if (p.reached[i]) {
+            rewrite_block(ir, &p, b, resolved, &num_resolved);
+            continue;
+        }
+        if (b == epilogue)
+            continue;
+        IRNode *end = b->last->next;
+        for (IRNode *node = b->first, *next; node != end; node = next) {
+            next = node->next;
+            if (node->instruction != COMMENT)
+                ir_remove(ir, node);
+        }
+    }
+    // unreachable blocks are gone, a resolved branch may now precede its target
+    for (int i = 0; i < num_resolved; i++)
+        remove_jump_to_next(ir, resolved[i]);
+    remove_dead_constants(ir, &p, fn);
+
+    free(resolved);
+    free(p.regs);
+    free(p.blocks);
+    free(p.users);
+    free(p.user_start);
+    free(p.taken);
+    free(p.edge_base);
+    free(p.reached);
+    free(p.value);
+    free_cfg(p.cfg);
+}
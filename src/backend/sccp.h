@@ -0,0 +1,36 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Sparse conditional constant propagation over a function in SSA form
+ *
+ * Finds the registers holding the same constant on every execution, with
+ * the algorithm of Wegman and Zadeck: each register starts undefined and
+ * only moves down the lattice (undefined, constant, varying), while blocks
+ * are only evaluated once an edge leading to them is known to be taken.
+ * Branches whose operands are both constant take a single edge, so the
+ * values flowing along the other one never reach the phis.
+ *
+ * The function is then rewritten:
+ * - `ADD/SUB/MUL/DIV/REM/SLL/SRA/SRL`, moves and phis computing a constant
+ *   become an `li` of the result (`li` whose value is no longer read are
+ *   removed);
+ * - a constant operand fitting in 12 bits (`LOWER_LIMIT`..`UPPER_LIMIT`)
+ *   is folded into an `addi` or an immediate shift, a multiplication by a
+ *   power of two becomes a `slli`, and a zero operand becomes `x0`;
+ * - a branch with constant operands becomes a `j` to its target, or is
+ *   removed when never taken;
+ * - the instructions of blocks never reached are removed (comments stay),
+ *   and the phi operands of the edges removed with them.
+ *
+ * Division and remainder by zero or overflowing (`INT_MIN / -1`) are left
+ * to run.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function in SSA form (see ssa.h)
+ */
+void propagate_constants(IR *ir, IRFunction *fn);
+
+#endif // SCCP_H
@@ -0,0 +1,500 @@
+#include "ssa.h"
+#include "../utils/cfg.h"
+#include "../utils/ir.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct Frontiers
+ * @brief Dominance frontier of every block, as lists of block IDs
+ */
+typedef struct Frontiers {
+    int **blocks;
+    int *size;
+    int *capacity;
+} Frontiers;
+
+/**
+ * @struct Renaming
+ * @brief State of the renaming walk over the dominator tree
+ *
+ * Registers being renamed get a dense index through `var`. Each one has a
+ * stack of the definitions reaching the current block, and `log` records
+ * the pushes made by the blocks on the current path so they can be undone.
+ */
+typedef struct Renaming {
+    IR *ir;
+    int num_regs;   /**< size of `var`, registers created later are never renamed */
+    int *var;       /**< register ID -> index of the variable, -1 if not renamed */
+    int **stack;    /**< reaching definitions of each variable */
+    int *top;       /**< number of entries in each stack */
+    int *capacity;  /**< room in each stack */
+    int *log;       /**< variables pushed, in order */
+    int log_size;
+    int log_capacity;
+} Renaming;
+
+/**
+ * @brief Compute the dominance frontier of every reachable block
+ *
+ * A join block belongs to the frontier of each block on the dominator tree
+ * path from one of its predecessors up to (but excluding) its immediate
+ * dominator (Cooper, Harvey and Kennedy).
+ */
+static Frontiers compute_frontiers(const CFG *cfg) {
+    int n = cfg->num_blocks;
+    Frontiers df;
+    df.blocks = (int **)calloc(n, sizeof(int *));
+    df.size = (int *)calloc(n, sizeof(int));
+    df.capacity = (int *)calloc(n, sizeof(int));
+
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *b = cfg->rpo[i];
+        if (b->num_preds < 2)
+            continue;
+
+        for (int j = 0; j < b->num_preds; j++) {
+            BasicBlock *runner = b->preds[j];
+            if (runner->rpo < 0)
+                continue;
+
+            while (runner != b->idom) {
+                int r = runner->id;
+                // blocks are added one join at a time, so a duplicate is the last entry
+                if (df.size[r] == 0 || df.blocks[r][df.size[r] - 1] != b->id) {
+                    if (df.size[r] == df.capacity[r]) {
+                        df.capacity[r] = df.capacity[r] == 0 ? 2 : 2 * df.capacity[r];
+                        df.blocks[r] = (int *)realloc(df.blocks[r], df.capacity[r] * sizeof(int));
+                    }
+                    df.blocks[r][df.size[r]++] = b->id;
+                }
+                runner = runner->idom;
+            }
+        }
+    }
+
+    return df;
+}
+
+static void free_frontiers(Frontiers *df, int n) {
+    for (int i = 0; i < n; i++)
+        free(df->blocks[i]);
+    free(df->blocks);
+    free(df->size);
+    free(df->capacity);
+}
+
+/**
+ * @brief Place a phi for a register at the start of a block
+ *
+ * Phis go right after the label of the block. Every operand starts as the
+ * register itself and is set by the renaming.
+ */
+static void insert_phi(IR *ir, BasicBlock *b, int reg) {
+    IRNode *phi = new_ir_node(PHI);
+    phi->src_kind = REG_SRC;
+    phi->dest = reg;
+    phi->imm = reg;
+    phi->num_args = b->num_preds;
+    phi->args = (int *)malloc(b->num_preds * sizeof(int));
+    for (int i = 0; i < b->num_preds; i++)
+        phi->args[i] = reg;
+    phi->block = b;
+
+    if (b->first->instruction == LABEL) {
+        ir_insert_after(ir, b->first, phi);
+        if (b->last == b->first)
+            b->last = phi;
+    } else {
+        ir_insert_before(ir, b->first, phi);
+        b->first = phi;
+    }
+}
+
+/**
+ * @brief Insert the phis of every register defined more than once
+ *
+ * Only registers read in a block before being written there (live across
+ * blocks) get phis; the others are renamed without any.
+ *
+ * @param ir Pointer to IR structure
+ * @param cfg Control-flow graph of the function, with dominators
+ * @param num_defs Number of definitions of each register
+ */
+static void insert_phis(IR *ir, CFG *cfg, const int *num_defs) {
+    int num_regs = ir->next_temp_reg;
+    int n = cfg->num_blocks;
+
+    // registers read before being written in some block
+    bool *global = (bool *)calloc(num_regs, sizeof(bool));
+    int *defined_in = (int *)malloc(num_regs * sizeof(int));
+    for (int i = 0; i < num_regs; i++)
+        defined_in[i] = -1;
+    for (int i = 0; i < n; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+            int uses[] = {node->src1, node->src2};
+            for (int k = 0; k < 2; k++) {
+                if (uses[k] > 0 && defined_in[uses[k]] != b->id)
+                    global[uses[k]] = true;
+            }
+            if (node->dest > 0)
+                defined_in[node->dest] = b->id;
+        }
+    }
+
+    // blocks defining each variable, bucketed by register
+    int *start = (int *)calloc(num_regs + 1, sizeof(int));
+    for (int i = 0; i < num_regs; i++)
+        defined_in[i] = -1;
+    for (int i = 0; i < n; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        for (IRNode *node = b->first; b->rpo >= 0 && node != b->last->next; node = node->next) {
+            int reg = node->dest;
+            if (reg > 0 && num_defs[reg] >= 2 && global[reg] && defined_in[reg] != i) {
+                defined_in[reg] = i;
+                start[reg + 1]++;
+            }
+        }
+    }
+    for (int reg = 0; reg < num_regs; reg++)
+        start[reg + 1] += start[reg];
+    int *def_blocks = (int *)malloc((start[num_regs] + 1) * sizeof(int));
+    int *fill = (int *)malloc(num_regs * sizeof(int));
+    memcpy(fill, start, num_regs * sizeof(int));
+    for (int i = 0; i < num_regs; i++)
+        defined_in[i] = -1;
+    for (int i = 0; i < n; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        for (IRNode *node = b->first; b->rpo >= 0 && node != b->last->next; node = node->next) {
+            int reg = node->dest;
+            if (reg > 0 && num_defs[reg] >= 2 && global[reg] && defined_in[reg] != i) {
+                defined_in[reg] = i;
+                def_blocks[fill[reg]++] = i;
+            }
+        }
+    }
+
+    Frontiers df = compute_frontiers(cfg);
+    int *has_phi = (int *)calloc(n, sizeof(int));
+    int *queued = (int *)calloc(n, sizeof(int));
+    int *worklist = (int *)malloc(n * sizeof(int));
+
+    // blocks are marked with the register, so the marks never need clearing
+    for (int reg = 1; reg < num_regs; reg++) {
+        int size = 0;
+        for (int k = start[reg]; k < start[reg + 1]; k++) {
+            queued[def_blocks[k]] = reg;
+            worklist[size++] = def_blocks[k];
+        }
+
+        while (size > 0) {
+            int d = worklist[--size];
+            for (int k = 0; k < df.size[d]; k++) {
+                int y = df.blocks[d][k];
+                if (has_phi[y] == reg)
+                    continue;
+                insert_phi(ir, &cfg->blocks[y], reg);
+                has_phi[y] = reg;
+                if (queued[y] != reg) {
+                    queued[y] = reg;
+                    worklist[size++] = y;
+                }
+            }
+        }
+    }
+
+    free(worklist);
+    free(queued);
+    free(has_phi);
+    free_frontiers(&df, n);
+    free(fill);
+    free(def_blocks);
+    free(start);
+    free(defined_in);
+    free(global);
+}
+
+static void push_def(Renaming *rn, int v, int reg) {
+    if (rn->top[v] == rn->capacity[v]) {
+        rn->capacity[v] = rn->capacity[v] == 0 ? 4 : 2 * rn->capacity[v];
+        rn->stack[v] = (int *)realloc(rn->stack[v], rn->capacity[v] * sizeof(int));
+    }
+    rn->stack[v][rn->top[v]++] = reg;
+
+    if (rn->log_size == rn->log_capacity) {
+        rn->log_capacity = rn->log_capacity == 0 ? 16 : 2 * rn->log_capacity;
+        rn->log = (int *)realloc(rn->log, rn->log_capacity * sizeof(int));
+    }
+    rn->log[rn->log_size++] = v;
+}
+
+/**
+ * @brief Definition of a register reaching the current point of the walk
+ */
+static int reaching_def(const Renaming *rn, int reg) {
+    if (reg <= 0 || reg >= rn->num_regs || rn->var[reg] < 0)
+        return reg;
+    int v = rn->var[reg];
+    return rn->top[v] > 0 ? rn->stack[v][rn->top[v] - 1] : reg;
+}
+
+/**
+ * @brief Give a fresh register to a definition and make it the reaching one
+ */
+static int new_def(Renaming *rn, int reg) {
+    int name = register_new_temp(rn->ir);
+    push_def(rn, rn->var[reg], name);
+    return name;
+}
+
+/**
+ * @brief Rename the definitions and uses of a block and of the blocks it
+ *        dominates
+ */
+static void rename_block(Renaming *rn, BasicBlock *b) {
+    int log_size = rn->log_size;
+
+    for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+        if (node->instruction != PHI) {
+            node->src1 = reaching_def(rn, node->src1);
+            node->src2 = reaching_def(rn, node->src2);
+        }
+        if (node->dest > 0 && node->dest < rn->num_regs && rn->var[node->dest] >= 0)
+            node->dest = new_def(rn, node->dest);
+    }
+
+    // fill the operands of the phis of the successors coming from this block
+    for (int k = 0; k < b->num_succs; k++) {
+        BasicBlock *s = b->succ[k];
+        for (int j = 0; j < s->num_preds; j++) {
+            if (s->preds[j] != b)
+                continue;
+            // phis only follow the label and comments starting the block
+            for (IRNode *node = s->first; node != s->last->next; node = node->next) {
+                if (node->instruction == PHI)
+                    node->args[j] = reaching_def(rn, (int)node->imm);
+                else if (node->instruction != LABEL && node->instruction != COMMENT)
+                    break;
+            }
+        }
+    }
+
+    for (int i = 0; i < b->num_children; i++)
+        rename_block(rn, b->children[i]);
+
+    while (rn->log_size > log_size)
+        rn->top[rn->log[--rn->log_size]]--;
+}
+
+void build_ssa(IR *ir, IRFunction *fn) {
+    int num_regs = ir->next_temp_reg;
+    int *num_defs = (int *)calloc(num_regs, sizeof(int));
+    for (IRNode *node = fn->entry; node != fn->exit->next; node = node->next) {
+        if (node->dest > 0)
+            num_defs[node->dest]++;
+    }
+
+    Renaming rn = {0};
+    rn.ir = ir;
+    rn.num_regs = num_regs;
+    rn.var = (int *)malloc(num_regs * sizeof(int));
+    int num_vars = 0;
+    for (int reg = 0; reg < num_regs; reg++)
+        rn.var[reg] = num_defs[reg] >= 2 ? num_vars++ : -1;
+
+    if (num_vars > 0) {
+        CFG *cfg = build_cfg(fn);
+        cfg_dominators(cfg);
+        insert_phis(ir, cfg, num_defs);
+
+        rn.stack = (int **)calloc(num_vars, sizeof(int *));
+        rn.top = (int *)calloc(num_vars, sizeof(int));
+        rn.capacity = (int *)calloc(num_vars, sizeof(int));
+        rename_block(&rn, cfg->rpo[0]);
+
+        for (int v = 0; v < num_vars; v++)
+            free(rn.stack[v]);
+        free(rn.stack);
+        free(rn.top);
+        free(rn.capacity);
+        free(rn.log);
+        free_cfg(cfg);
+    }
+
+    free(rn.var);
+    free(num_defs);
+}
+
+/**
+ * @brief Emit a parallel copy as a sequence of moves
+ *
+ * A move is emitted once no pending copy still reads its destination.
+ * When only cycles are left, the destination of one copy is saved in a
+ * fresh register and the copies reading it read the saved value instead.
+ *
+ * @param ir Pointer to IR structure
+ * @param pos Node the moves are inserted before
+ * @param dest Destination of each copy (all different)
+ * @param src Source of each copy, updated while breaking cycles
+ * @param n Number of copies
+ */
+static void sequentialize(IR *ir, IRNode *pos, int *dest, int *src, int n) {
+    bool *done = (bool *)malloc(n * sizeof(bool));
+    int pending = 0;
+    for (int i = 0; i < n; i++) {
+        done[i] = dest[i] == src[i];
+        pending += !done[i];
+    }
+
+    while (pending > 0) {
+        bool progress = false;
+        for (int i = 0; i < n; i++) {
+            if (done[i])
+                continue;
+            bool read = false;
+            for (int k = 0; k < n && !read; k++)
+                read = !done[k] && k != i && src[k] == dest[i];
+            if (read)
+                continue;
+
+            IRNode *mov = new_ir_node(MOV);
+            mov->src_kind = REG_SRC;
+            mov->dest = dest[i];
+            mov->src1 = src[i];
+            ir_insert_before(ir, pos, mov);
+            done[i] = true;
+            pending--;
+            progress = true;
+        }
+        if (progress)
+            continue;
+
+        // every pending copy is on a cycle: save one destination and retry
+        for (int i = 0; i < n; i++) {
+            if (done[i])
+                continue;
+            IRNode *mov = new_ir_node(MOV);
+            mov->src_kind = REG_SRC;
+            mov->dest = register_new_temp(ir);
+            mov->src1 = dest[i];
+            ir_insert_before(ir, pos, mov);
+            for (int k = 0; k < n; k++) {
+                if (!done[k] && src[k] == dest[i])
+                    src[k] = mov->dest;
+            }
+            break;
+        }
+    }
+
+    free(done);
+}
+
+/**
+ * @brief Split the taken edge of a conditional branch
+ *
+ * `b<cond> L` becomes `b<!cond> split_N; j L; split_N:`, so the copies of
+ * the edge can be placed before the new jump without running on the
+ * fall-through path.
+ *
+ * @return The new jump, the copies go before it
+ */
+static IRNode *split_taken_edge(IR *ir, IRNode *branch) {
+    char name[32];
+    snprintf(name, sizeof(name), "split_%d", register_new_label(ir));
+
+    IRNode *label = new_ir_node(LABEL);
+    label->comment = strdup(name);
+    IRNode *jump = new_ir_node(JUMP);
+    jump->comment = strdup(branch->comment);
+    jump->target = branch->target;
+
+    branch->instruction = ir_inverse_branch(branch->instruction);
+    free(branch->comment);
+    branch->comment = strdup(name);
+    branch->target = label;
+
+    ir_insert_after(ir, branch, jump);
+    ir_insert_after(ir, jump, label);
+    return jump;
+}
+
+void destroy_ssa(IR *ir, IRFunction *fn) {
+    CFG *cfg = build_cfg(fn);
+    int n = cfg->num_blocks;
+
+    // branch targets, taken before any edge is split
+    BasicBlock **taken = (BasicBlock **)calloc(n, sizeof(BasicBlock *));
+    for (int i = 0; i < n; i++) {
+        IRNode *term = block_terminator(&cfg->blocks[i]);
+        if (term != NULL && term->instruction != JUMP && term->instruction != JUMP_REG &&
+            term->target != NULL)
+            taken[i] = term->target->block;
+    }
+
+    int capacity = 8, num_phis = 0, num_dead = 0, dead_capacity = 8;
+    IRNode **phis = (IRNode **)malloc(capacity * sizeof(IRNode *));
+    IRNode **dead = (IRNode **)malloc(dead_capacity * sizeof(IRNode *));
+    int *dest = (int *)malloc(capacity * sizeof(int));
+    int *src = (int *)malloc(capacity * sizeof(int));
+
+    for (int i = 0; i < n; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        num_phis = 0;
+        for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+            if (node->instruction != PHI)
+                continue;
+            if (num_phis == capacity) {
+                capacity *= 2;
+                phis = (IRNode **)realloc(phis, capacity * sizeof(IRNode *));
+                dest = (int *)realloc(dest, capacity * sizeof(int));
+                src = (int *)realloc(src, capacity * sizeof(int));
+            }
+            phis[num_phis++] = node;
+            if (num_dead == dead_capacity) {
+                dead_capacity *= 2;
+                dead = (IRNode **)realloc(dead, dead_capacity * sizeof(IRNode *));
+            }
+            dead[num_dead++] = node;
+        }
+        if (num_phis == 0)
+            continue;
+
+        bool taken_seen = false;
+        for (int j = 0; j < b->num_preds; j++) {
+            BasicBlock *p = b->preds[j];
+            if (p->rpo < 0)
+                continue;
+
+            // `build_cfg` adds the taken edge of a branch before its fall-through
+            IRNode *term = block_terminator(p);
+            IRNode *pos;
+            if (term != NULL && term->instruction == JUMP) {
+                pos = term;
+            } else if (taken[p->id] == b && !(taken_seen && p == b->preds[j - 1])) {
+                pos = split_taken_edge(ir, term);
+                taken_seen = true;
+            } else {
+                pos = b->first;
+            }
+
+            for (int k = 0; k < num_phis; k++) {
+                dest[k] = phis[k]->dest;
+                src[k] = phis[k]->args[j];
+            }
+            sequentialize(ir, pos, dest, src, num_phis);
+        }
+    }
+
+    for (int i = 0; i < num_dead; i++)
+        ir_remove(ir, dead[i]);
+
+    free(src);
+    free(dest);
+    free(dead);
+    free(phis);
+    free(taken);
+    free_cfg(cfg);
+}
@@ -0,0 +1,49 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "../utils/ir.h"
+
+/**
+ * @brief Put a function in static single assignment form
+ *
+ * Every virtual register written by more than one instruction (e.g. a
+ * variable kept in a register and assigned in several places) is split
+ * into one register per definition:
+ *
+ * 1. **Dominators**: the dominator tree is built with the algorithm of
+ *    Cooper, Harvey and Kennedy and the dominance frontier of each block is
+ *    derived from it.
+ * 2. **Phi insertion**: a `PHI` is placed at the iterated dominance frontier
+ *    of the definitions of each register that is live across blocks
+ *    (semi-pruned SSA).
+ * 3. **Renaming**: the dominator tree is walked in preorder with a stack of
+ *    reaching definitions per register, giving each definition a fresh
+ *    register and each use (and phi operand) the definition reaching it.
+ *
+ * Registers already defined once are left untouched. A use reached by no
+ * definition keeps the original register, which is then never written,
+ * as for an uninitialized variable.
+ *
+ * @param ir Pointer to IR structure (renaming creates new registers)
+ * @param fn Function to convert
+ */
+void build_ssa(IR *ir, IRFunction *fn);
+
+/**
+ * @brief Take a function out of SSA form
+ *
+ * Replaces the phis of each block with copies on its incoming edges. The
+ * copies of one edge form a parallel copy (all phis read their operands
+ * before any of them is written), which is sequentialized into moves,
+ * breaking cycles with a fresh register. Copies for an edge that leaves a
+ * conditional branch and enters a block with several predecessors (a
+ * critical edge) go in a new block: the branch is inverted to skip it, so
+ * the other successor is reached as before.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function in SSA form, with `args` of every phi in the order of
+ *           the predecessors given by `build_cfg`
+ */
+void destroy_ssa(IR *ir, IRFunction *fn);
+
+#endif // SSA_H
@@ -10,11 +10,13 @@
 #include <stdlib.h>
 
 /* counter for global variable memory locations */
-static unsigned int global_address = 0x10008000;
+static unsigned int global_address = GLOBAL_BASE;
 
 /* counters for stack frame offsets */
 static int param_offset = 0;
 static int local_offset = 0;
+/* number of parameters of the current function */
+static int param_count = 0;
 
 /* counter for variables scopes */
 static int scope = 0;
@@ -24,6 +26,18 @@ static int last_scope;
 /* stack to store scopes */
 Stack *stack;
 
+/* Function local_slot reserves the stack slot of a
+ * local variable and returns its offset. From -O1 on
+ * scalars and parameters are kept in virtual registers
+ * (see cgen.c) and get no slot
+ */
+static int local_slot(ASTNode *n, int size) {
+    if (n->kind.expr != ArrDecl && OptLevel >= 1)
+        return 0;
+    local_offset -= 4 * size;
+    return local_offset;
+}
+
 /* Procedure type_error display an error message
  * regarding errors during type check
  */
@@ -99,16 +113,14 @@ static void insert_node(ASTNode *n) {
                     st_insert(n, n->scope, global_address, 0);
                     global_address += size * 4;
                 } else {
-                    local_offset -= 4 * size;
-                    st_insert(n, n->scope, 0, local_offset);
+                    st_insert(n, n->scope, 0, local_slot(n, size));
                 }
             } else if (bucket->node->kind.expr == FuncDecl) {
                 /* function defined with the same name raise an error */
                 var_error(n, var_type_str(n->kind.expr),
                           "has the name of a function already declared", s_top(stack));
             } else if (bucket->scope != s_top(stack)) { // new scope
-                local_offset -= 4 * size;
-                st_insert(n, n->scope, 0, local_offset);
+                st_insert(n, n->scope, 0, local_slot(n, size));
             } else { // already in table raise an error
                 var_error(n, var_type_str(n->kind.expr), "redefined", s_top(stack));
             }
@@ -116,6 +128,7 @@ static void insert_node(ASTNode *n) {
         case FuncDecl:
             param_offset = 8;
             local_offset = 0;
+            param_count = 0;
             n->scope = s_top(stack);
             if (st_lookup(n->attr.name, s_top(stack)) == NULL) {
                 st_insert(n, n->scope, 0, 0);
@@ -125,10 +138,15 @@ static void insert_node(ASTNode *n) {
             break;
         case ParamVar:
         case ParamArr:
-            // parameters are defined before entering a new scope
+            // parameters are defined before entering a new scope; the ones
+            // passed in registers are stored below fp, the others are above it
             n->scope = scope + 1;
-            st_insert(n, scope + 1, 0, param_offset);
-            param_offset += 4;
+            if (param_count++ < ARG_REGISTERS) {
+                st_insert(n, scope + 1, 0, local_slot(n, 1));
+            } else {
+                st_insert(n, scope + 1, 0, param_offset);
+                param_offset += 4;
+            }
             break;
         case Var:
         case Arr:
@@ -47,6 +47,43 @@ extern bool TraceAnalyze;
  */
 extern bool TraceCode;
 
+/* RegisterBudget is the number of physical registers
+ * the register allocator may use (--regs=N)
+ */
+extern int RegisterBudget;
+
+/* RegAllocator selects the register allocation
+ * algorithm (--ra=color, --ra=linear or --ra=irc)
+ */
+typedef enum { GRAPH_COLORING, LINEAR_SCAN, ITERATED_COALESCING } RegAllocatorKind;
+extern RegAllocatorKind RegAllocator;
+
+/* RegAllocStats = TRUE causes the register allocator
+ * to report the registers it spilled, with their spill
+ * costs, to the listing file (--ra-stats)
+ */
+extern bool RegAllocStats;
+
+/* PeepholeStats = TRUE causes the peephole optimizer
+ * to report how many times each of its rules fired
+ * to the listing file (--peephole-stats)
+ */
+extern bool PeepholeStats;
+
+/* OptLevel is the optimization level (-O0, -O1, -O2).
+ * From -O1 on, scalar variables are kept in registers,
+ * constants are propagated, redundant computations are
+ * reused, loop invariants are hoisted, array indexing in
+ * loops is strength-reduced, constant address offsets are
+ * folded into loads and stores, dead code is removed,
+ * frames only keep the registers and slots they use,
+ * tail calls become jumps and the allocated code goes
+ * through the peephole optimizer.
+ * From -O2 on, iterated register coalescing is the
+ * default register allocator
+ */
+extern int OptLevel;
+
 /* Error = TRUE prevents further passes if an error occurs */
 extern bool Error;
 
@@ -1,12 +1,23 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "global.h"
+#include "backend/address.h"
 #include "backend/cgen.h"
+#include "backend/dce.h"
+#include "backend/frame.h"
+#include "backend/gvn.h"
+#include "backend/induction.h"
+#include "backend/licm.h"
+#include "backend/peephole.h"
 #include "backend/reg_allocation.h"
+#include "backend/sccp.h"
+#include "backend/ssa.h"
 #include "frontend/analyze.h"
 #include "frontend/parse.h"
 #include "utils/ir.h"
@@ -25,6 +36,12 @@ bool TraceParse = false;
 bool TraceAnalyze = false;
 bool TraceCode = false;
 
+int RegisterBudget = NUM_ALLOCATABLE;
+RegAllocatorKind RegAllocator = GRAPH_COLORING;
+int OptLevel = 0;
+bool RegAllocStats = false;
+bool PeepholeStats = false;
+
 bool Error = false;
 
 extern void yylex_destroy();
@@ -34,6 +51,7 @@ int main(int argc, char **argv) {
     char out_file[256] = {0};
     bool first_time = true;
     bool has_multiple_srcs = false;
+    bool allocator_chosen = false;
 
     if (argc == 2 && strcmp(argv[1], "--help") == 0) {
         print_help(argv[0]);
@@ -49,6 +67,31 @@ int main(int argc, char **argv) {
             TraceAnalyze = true;
         } else if (strcmp(argv[i], "--tc") == 0) {
             TraceCode = true;
+        } else if (strncmp(argv[i], "--regs=", 7) == 0) {
+            char *end;
+            long regs = strtol(argv[i] + 7, &end, 10);
+            if (*end != '\0' || regs < MIN_ALLOCATABLE || regs > NUM_ALLOCATABLE) {
+                fprintf(stderr, "Error: --regs expects a number between %d and %d\n",
+                        MIN_ALLOCATABLE, NUM_ALLOCATABLE);
+                return 1;
+            }
+            RegisterBudget = (int)regs;
+        } else if (strcmp(argv[i], "--ra=color") == 0) {
+            RegAllocator = GRAPH_COLORING;
+            allocator_chosen = true;
+        } else if (strcmp(argv[i], "--ra=linear") == 0) {
+            RegAllocator = LINEAR_SCAN;
+            allocator_chosen = true;
+        } else if (strcmp(argv[i], "--ra=irc") == 0) {
+            RegAllocator = ITERATED_COALESCING;
+            allocator_chosen = true;
+        } else if (strcmp(argv[i], "--ra-stats") == 0) {
+            RegAllocStats = true;
+        } else if (strcmp(argv[i], "--peephole-stats") == 0) {
+            PeepholeStats = true;
+        } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 ||
+                   strcmp(argv[i], "-O2") == 0) {
+            OptLevel = argv[i][2] - '0';
         } else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
                 strncpy(out_file, argv[++i], sizeof(out_file) - 1);
@@ -71,6 +114,9 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (!allocator_chosen && OptLevel >= 2)
+        RegAllocator = ITERATED_COALESCING;
+
     if (has_multiple_srcs) {
         fprintf(stderr, "Error: Too many input files.");
         print_help(argv[0]);
@@ -149,7 +195,26 @@ int main(int argc, char **argv) {
     IR *ir = NULL;
     ir = gen_ir(tree);
     // print_ir(ir, code);
+    if (OptLevel >= 1) {
+        for (IRFunction *fn = ir->functions; fn != NULL; fn = fn->next) {
+            build_ssa(ir, fn);
+            propagate_constants(ir, fn);
+            number_values(ir, fn);
+            hoist_loop_invariants(ir, fn);
+            reduce_induction_variables(ir, fn);
+            fold_address_offsets(ir, fn);
+            // the loop passes recompute values in the preheaders, and the
+            // address folding the upper bits of global addresses
+            number_values(ir, fn);
+            destroy_ssa(ir, fn);
+            eliminate_dead_code(ir, fn);
+        }
+    }
     int *color_map = allocate_registers(ir);
+    if (OptLevel >= 1) {
+        layout_frames(ir, color_map);
+        peephole_optimize(ir, color_map);
+    }
     ObjectCode *obj = ir_to_obj_code(ir, color_map, true);
     write_asm(obj, code);
 
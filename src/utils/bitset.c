@@ -5,6 +5,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Union, difference and equality run over 256-bit (AVX2) or 128-bit (NEON)
+ * lanes when the target supports them, finishing with a scalar word loop.
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 BitSet *new_bitset(int size) {
     BitSet *bs = (BitSet *)malloc(sizeof(BitSet));
     bs->size = size;
@@ -13,6 +22,19 @@ BitSet *new_bitset(int size) {
     return bs;
 }
 
+BitSet *new_bitset_slab(int count, int size) {
+    BitSet *slab = (BitSet *)malloc(count * sizeof(BitSet));
+    int n_words = (int)(size + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    word_t *words = (word_t *)calloc((size_t)count * n_words, sizeof(word_t));
+
+    for (int i = 0; i < count; i++) {
+        slab[i].size = size;
+        slab[i].n_words = n_words;
+        slab[i].words = words + (size_t)i * n_words;
+    }
+    return slab;
+}
+
 BitSet *bitset_copy(BitSet *bs) {
     if (bs == NULL)
         return NULL;
@@ -22,6 +44,12 @@ BitSet *bitset_copy(BitSet *bs) {
     return new_bs;
 }
 
+void bitset_assign(BitSet *dest, const BitSet *src) {
+    memcpy(dest->words, src->words, min(dest->n_words, src->n_words) * sizeof(word_t));
+}
+
+void bitset_clear_all(BitSet *bs) { memset(bs->words, 0, bs->n_words * sizeof(word_t)); }
+
 void bitset_set(BitSet *bs, int pos) {
     if (pos >= bs->size)
         return;
@@ -66,7 +94,21 @@ void bitset_union(BitSet *dest, const BitSet *src) {
         return;
 
     int n_words = min(dest->n_words, src->n_words);
-    for (int i = 0; i < n_words; i++) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n_words; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dest->words + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src->words + i));
+        _mm256_storeu_si256((__m256i *)(dest->words + i), _mm256_or_si256(a, b));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n_words; i += 2) {
+        uint64x2_t a = vld1q_u64(dest->words + i);
+        uint64x2_t b = vld1q_u64(src->words + i);
+        vst1q_u64(dest->words + i, vorrq_u64(a, b));
+    }
+#endif
+    for (; i < n_words; i++) {
         dest->words[i] |= src->words[i];
     }
 }
@@ -76,11 +118,46 @@ void bitset_diff(BitSet *dest, const BitSet *src) {
         return;
 
     int n_words = min(dest->n_words, src->n_words);
-    for (int i = 0; i < n_words; i++) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n_words; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dest->words + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src->words + i));
+        _mm256_storeu_si256((__m256i *)(dest->words + i), _mm256_andnot_si256(b, a));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n_words; i += 2) {
+        uint64x2_t a = vld1q_u64(dest->words + i);
+        uint64x2_t b = vld1q_u64(src->words + i);
+        vst1q_u64(dest->words + i, vbicq_u64(a, b));
+    }
+#endif
+    for (; i < n_words; i++) {
         dest->words[i] &= ~src->words[i];
     }
 }
 
+bool bitset_union_changed(BitSet *dest, const BitSet *src) {
+    word_t changed = 0;
+    int n_words = min(dest->n_words, src->n_words);
+    for (int i = 0; i < n_words; i++) {
+        word_t w = dest->words[i] | src->words[i];
+        changed |= w ^ dest->words[i];
+        dest->words[i] = w;
+    }
+    return changed != 0;
+}
+
+bool bitset_transfer(BitSet *in, const BitSet *use, const BitSet *out, const BitSet *def) {
+    word_t changed = 0;
+    for (int i = 0; i < in->n_words; i++) {
+        word_t w = use->words[i] | (out->words[i] & ~def->words[i]);
+        changed |= w ^ in->words[i];
+        in->words[i] = w;
+    }
+    return changed != 0;
+}
+
 bool bitset_equals(const BitSet *bs1, const BitSet *bs2) {
     if (bs1 == NULL && bs2 == NULL)
         return true;
@@ -88,7 +165,79 @@ bool bitset_equals(const BitSet *bs1, const BitSet *bs2) {
     if (bs1 == NULL || bs2 == NULL)
         return false;
 
-    return memcmp(bs1->words, bs2->words, bs1->n_words * sizeof(word_t)) == 0;
+    int n_words = bs1->n_words;
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n_words; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(bs1->words + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(bs2->words + i));
+        __m256i x = _mm256_xor_si256(a, b);
+        if (!_mm256_testz_si256(x, x))
+            return false;
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n_words; i += 2) {
+        uint64x2_t x = veorq_u64(vld1q_u64(bs1->words + i), vld1q_u64(bs2->words + i));
+        if ((vgetq_lane_u64(x, 0) | vgetq_lane_u64(x, 1)) != 0)
+            return false;
+    }
+#endif
+    for (; i < n_words; i++) {
+        if (bs1->words[i] != bs2->words[i])
+            return false;
+    }
+    return true;
+}
+
+bool bitset_any(const BitSet *bs) {
+    if (bs == NULL)
+        return false;
+
+    for (int i = 0; i < bs->n_words; i++) {
+        if (bs->words[i] != 0)
+            return true;
+    }
+    return false;
+}
+
+bool bitset_intersects(const BitSet *bs1, const BitSet *bs2) {
+    if (bs1 == NULL || bs2 == NULL)
+        return false;
+
+    int n_words = min(bs1->n_words, bs2->n_words);
+    for (int i = 0; i < n_words; i++) {
+        if ((bs1->words[i] & bs2->words[i]) != 0)
+            return true;
+    }
+    return false;
+}
+
+int bitset_count(const BitSet *bs) {
+    if (bs == NULL)
+        return 0;
+
+    int count = 0;
+    for (int i = 0; i < bs->n_words; i++) {
+        count += __builtin_popcountll(bs->words[i]);
+    }
+    return count;
+}
+
+int bitset_next(const BitSet *bs, int pos) {
+    if (bs == NULL || pos < 0 || pos >= bs->size)
+        return -1;
+
+    int word_idx = pos / BITS_PER_WORD;
+    // drop the bits below `pos` in its word, then skip empty words
+    word_t word = bs->words[word_idx] & (~(word_t)0 << (pos % BITS_PER_WORD));
+    while (word == 0) {
+        if (++word_idx >= bs->n_words)
+            return -1;
+        word = bs->words[word_idx];
+    }
+
+    int next = (int)(word_idx * BITS_PER_WORD) + __builtin_ctzll(word);
+    return next < bs->size ? next : -1;
 }
 
 void print_bitset(const BitSet *bs) {
@@ -113,3 +262,11 @@ void destroy_biset(BitSet *bs) {
     free(bs->words);
     free(bs);
 }
+
+void destroy_bitset_slab(BitSet *slab) {
+    if (slab == NULL)
+        return;
+
+    free(slab[0].words);
+    free(slab);
+}
@@ -21,10 +21,25 @@ typedef struct BitSet {
  * @return A pointer to the new BitSet.
  */
 BitSet *new_bitset(int size);
+/**
+ * @brief Creates `count` BitSets sharing one contiguous block of words.
+ * @param count The number of BitSets (at least one).
+ * @param size The number of bits of each BitSet.
+ * @return A pointer to the first BitSet of the array, all cleared.
+ */
+BitSet *new_bitset_slab(int count, int size);
 /**
  * @brief Creates a copy of a BitSet.
  */
 BitSet *bitset_copy(BitSet *bs);
+/**
+ * @brief Copies the elements of src into dest without allocating (dest = src).
+ */
+void bitset_assign(BitSet *dest, const BitSet *src);
+/**
+ * @brief Removes every element of the BitSet.
+ */
+void bitset_clear_all(BitSet *bs);
 /**
  * @brief Adds an element to the BitSet.
  */
@@ -49,10 +64,42 @@ void bitset_union(BitSet *dest, const BitSet *src);
  * @brief Performs the difference of two BitSets (dest = dest - src).
  */
 void bitset_diff(BitSet *dest, const BitSet *src);
+/**
+ * @brief Performs dest = dest U src in place.
+ * @return true if dest gained any element.
+ */
+bool bitset_union_changed(BitSet *dest, const BitSet *src);
+/**
+ * @brief Computes the dataflow transfer in = use U (out - def) in place.
+ * @return true if `in` changed.
+ */
+bool bitset_transfer(BitSet *in, const BitSet *use, const BitSet *out, const BitSet *def);
 /**
  * @brief Checks if two BitSets are equal.
  */
 bool bitset_equals(const BitSet *bs1, const BitSet *bs2);
+/**
+ * @brief Checks if the BitSet has any element.
+ */
+bool bitset_any(const BitSet *bs);
+/**
+ * @brief Checks if two BitSets have an element in common.
+ */
+bool bitset_intersects(const BitSet *bs1, const BitSet *bs2);
+/**
+ * @brief Counts the elements of the BitSet.
+ */
+int bitset_count(const BitSet *bs);
+/**
+ * @brief Finds the smallest element greater than or equal to `pos`.
+ * @return The element, or -1 if there is none.
+ */
+int bitset_next(const BitSet *bs, int pos);
+/**
+ * @brief Iterates `i` over the elements of the BitSet in increasing order,
+ * skipping whole empty words.
+ */
+#define BITSET_FOREACH(i, bs) for (int i = bitset_next(bs, 0); i >= 0; i = bitset_next(bs, i + 1))
 /**
  * @brief Prints the BitSet as binary string
  */
@@ -61,5 +108,9 @@ void print_bitset(const BitSet *bs1);
  * @brief Destroy a BitSet and free its memory.
  */
 void destroy_biset(BitSet *bs);
+/**
+ * @brief Destroy BitSets created by new_bitset_slab and free their memory.
+ */
+void destroy_bitset_slab(BitSet *slab);
 
 #endif // BITSET_H
@@ -0,0 +1,469 @@
+#include "cfg.h"
+#include "bitset.h"
+#include "ir.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Check if an instruction is a conditional branch
+ */
+static bool is_branch(const IRNode *node) {
+    switch (node->instruction) {
+    case BEQ:
+    case BNE:
+    case BLE:
+    case BLT:
+    case BGE:
+    case BGT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Check if an instruction ends a basic block
+ */
+static bool is_terminator(const IRNode *node) {
+    return node->instruction == JUMP || node->instruction == JUMP_REG || is_branch(node);
+}
+
+IRNode *block_terminator(const BasicBlock *b) {
+    for (IRNode *node = b->last; node != b->first->prev; node = node->prev) {
+        if (node->instruction != COMMENT)
+            return node;
+    }
+    return NULL;
+}
+
+IRNode *block_label(const BasicBlock *b) {
+    for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+        if (node->instruction == LABEL)
+            return node;
+        if (node->instruction != COMMENT)
+            break;
+    }
+    return NULL;
+}
+
+static void add_edge(BasicBlock *from, BasicBlock *to) {
+    from->succ[from->num_succs++] = to;
+
+    if (to->num_preds == to->cap_preds) {
+        to->cap_preds = to->cap_preds == 0 ? 2 : 2 * to->cap_preds;
+        to->preds = (BasicBlock **)realloc(to->preds, to->cap_preds * sizeof(BasicBlock *));
+    }
+    to->preds[to->num_preds++] = from;
+}
+
+/**
+ * @brief Split the function into blocks
+ *
+ * A block starts at the function entry, right after a terminator, and at
+ * every label, unless the block being built holds only comments so far (in
+ * which case the label joins it).
+ */
+static void split_blocks(CFG *cfg) {
+    IRNode *end = cfg->fn->exit->next;
+    int capacity = 16;
+    cfg->num_blocks = 0;
+    cfg->blocks = (BasicBlock *)malloc(capacity * sizeof(BasicBlock));
+
+    bool start = true, only_comments = false;
+    BasicBlock *b = NULL;
+    for (IRNode *node = cfg->fn->entry; node != end; node = node->next) {
+        if (start || (node->instruction == LABEL && !only_comments)) {
+            if (cfg->num_blocks == capacity) {
+                capacity *= 2;
+                cfg->blocks = (BasicBlock *)realloc(cfg->blocks, capacity * sizeof(BasicBlock));
+            }
+            b = &cfg->blocks[cfg->num_blocks];
+            b->id = cfg->num_blocks++;
+            b->first = node;
+            b->num_succs = 0;
+            b->preds = NULL;
+            b->num_preds = 0;
+            b->cap_preds = 0;
+            b->rpo = -1;
+            b->loop_depth = 0;
+            b->idom = NULL;
+            b->children = NULL;
+            b->num_children = 0;
+            b->use = b->def = b->live_in = b->live_out = NULL;
+            only_comments = true;
+        }
+        b->last = node;
+        only_comments = only_comments && node->instruction == COMMENT;
+        start = is_terminator(node);
+    }
+
+    // blocks may have moved while growing, set the back pointers at the end
+    for (int i = 0; i < cfg->num_blocks; i++) {
+        b = &cfg->blocks[i];
+        for (IRNode *node = b->first; node != b->last->next; node = node->next)
+            node->block = b;
+    }
+}
+
+/**
+ * @brief Order the reachable blocks in reverse postorder
+ *
+ * Iterative depth-first search from the entry block.
+ */
+static void compute_rpo(CFG *cfg) {
+    int n = cfg->num_blocks;
+    BasicBlock **postorder = (BasicBlock **)malloc(n * sizeof(BasicBlock *));
+    BasicBlock **stack = (BasicBlock **)malloc(n * sizeof(BasicBlock *));
+    int *next_succ = (int *)calloc(n, sizeof(int));
+    bool *visited = (bool *)calloc(n, sizeof(bool));
+    int num_post = 0, top = 0;
+
+    stack[top++] = &cfg->blocks[0];
+    visited[0] = true;
+    while (top > 0) {
+        BasicBlock *b = stack[top - 1];
+        if (next_succ[b->id] < b->num_succs) {
+            BasicBlock *s = b->succ[next_succ[b->id]++];
+            if (!visited[s->id]) {
+                visited[s->id] = true;
+                stack[top++] = s;
+            }
+        } else {
+            postorder[num_post++] = b;
+            top--;
+        }
+    }
+
+    cfg->num_reachable = num_post;
+    cfg->rpo = (BasicBlock **)malloc(n * sizeof(BasicBlock *));
+    for (int i = 0; i < num_post; i++) {
+        cfg->rpo[i] = postorder[num_post - 1 - i];
+        cfg->rpo[i]->rpo = i;
+    }
+
+    free(visited);
+    free(next_succ);
+    free(stack);
+    free(postorder);
+}
+
+CFG *build_cfg(IRFunction *fn) {
+    CFG *cfg = (CFG *)malloc(sizeof(CFG));
+    cfg->fn = fn;
+    cfg->sets = NULL;
+    cfg->dom_slab = NULL;
+    split_blocks(cfg);
+
+    for (int i = 0; i < cfg->num_blocks; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        BasicBlock *next = i + 1 < cfg->num_blocks ? &cfg->blocks[i + 1] : NULL;
+        IRNode *term = block_terminator(b);
+
+        if (term != NULL && term->instruction == JUMP_REG)
+            continue;
+        if (term != NULL && (term->instruction == JUMP || is_branch(term)))
+            add_edge(b, term->target->block);
+        if (next != NULL && (term == NULL || term->instruction != JUMP))
+            add_edge(b, next);
+    }
+
+    compute_rpo(cfg);
+    return cfg;
+}
+
+/**
+ * @brief Compute the `use` and `def` sets of a block
+ */
+static void block_use_def(BasicBlock *b, const int *local) {
+    int regs[NUM_REGISTERS];
+    for (IRNode *node = b->first; node != b->last->next; node = node->next) {
+        int n = ir_uses(node, regs);
+        for (int i = 0; i < n; i++) {
+            int bit = local[regs[i]];
+            if (bit >= 0 && !bitset_test(b->def, bit))
+                bitset_set(b->use, bit);
+        }
+
+        n = ir_defs(node, regs);
+        for (int i = 0; i < n; i++) {
+            if (local[regs[i]] >= 0)
+                bitset_set(b->def, local[regs[i]]);
+        }
+    }
+}
+
+void cfg_liveness(CFG *cfg, const int *local, int num_regs) {
+    int n = cfg->num_blocks;
+    destroy_bitset_slab(cfg->sets);
+    cfg->sets = new_bitset_slab(4 * n, num_regs);
+    for (int i = 0; i < n; i++) {
+        BasicBlock *b = &cfg->blocks[i];
+        b->use = &cfg->sets[4 * i];
+        b->def = &cfg->sets[4 * i + 1];
+        b->live_in = &cfg->sets[4 * i + 2];
+        b->live_out = &cfg->sets[4 * i + 3];
+        block_use_def(b, local);
+    }
+
+    // circular worklist, every block is queued at most once at a time
+    BasicBlock **worklist = (BasicBlock **)malloc(n * sizeof(BasicBlock *));
+    bool *queued = (bool *)malloc(n * sizeof(bool));
+    int head = 0, size = 0;
+    for (int i = cfg->num_reachable - 1; i >= 0; i--)
+        worklist[size++] = cfg->rpo[i];
+    for (int i = 0; i < n; i++) {
+        queued[i] = cfg->blocks[i].rpo >= 0;
+        if (!queued[i]) {
+            worklist[size++] = &cfg->blocks[i];
+            queued[i] = true;
+        }
+    }
+
+    while (size > 0) {
+        BasicBlock *b = worklist[head];
+        head = (head + 1) % n;
+        size--;
+        queued[b->id] = false;
+
+        // `out[b]` = U_{s in succ(b)} `in[s]`
+        bitset_clear_all(b->live_out);
+        for (int i = 0; i < b->num_succs; i++)
+            bitset_union_changed(b->live_out, b->succ[i]->live_in);
+
+        // `in[b]` <- use(b) U (`out[b]` - def(b))
+        if (!bitset_transfer(b->live_in, b->use, b->live_out, b->def))
+            continue;
+
+        for (int i = 0; i < b->num_preds; i++) {
+            BasicBlock *p = b->preds[i];
+            if (!queued[p->id]) {
+                queued[p->id] = true;
+                worklist[(head + size) % n] = p;
+                size++;
+            }
+        }
+    }
+
+    free(queued);
+    free(worklist);
+}
+
+void cfg_loop_depth(CFG *cfg) {
+    int n = cfg->num_blocks;
+    int *mark = (int *)malloc(n * sizeof(int));
+    BasicBlock **stack = (BasicBlock **)malloc(n * sizeof(BasicBlock *));
+    for (int i = 0; i < n; i++) {
+        mark[i] = -1;
+        cfg->blocks[i].loop_depth = 0;
+    }
+
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *header = cfg->rpo[i];
+        bool is_header = false;
+        int top = 0;
+
+        // walk backwards from the sources of the back edges to the header
+        mark[header->id] = header->id;
+        for (int j = 0; j < header->num_preds; j++) {
+            BasicBlock *p = header->preds[j];
+            if (p->rpo < header->rpo)
+                continue;
+            is_header = true;
+            if (mark[p->id] != header->id) {
+                mark[p->id] = header->id;
+                stack[top++] = p;
+            }
+        }
+        if (!is_header)
+            continue;
+        header->loop_depth++;
+
+        while (top > 0) {
+            BasicBlock *b = stack[--top];
+            b->loop_depth++;
+            for (int j = 0; j < b->num_preds; j++) {
+                BasicBlock *p = b->preds[j];
+                if (p->rpo >= 0 && mark[p->id] != header->id) {
+                    mark[p->id] = header->id;
+                    stack[top++] = p;
+                }
+            }
+        }
+    }
+
+    free(stack);
+    free(mark);
+}
+
+/**
+ * @brief Nearest common dominator of two blocks in the tree built so far
+ */
+static BasicBlock *intersect(BasicBlock *a, BasicBlock *b) {
+    while (a != b) {
+        while (a->rpo > b->rpo)
+            a = a->idom;
+        while (b->rpo > a->rpo)
+            b = b->idom;
+    }
+    return a;
+}
+
+void cfg_dominators(CFG *cfg) {
+    BasicBlock *entry = cfg->rpo[0];
+    for (int i = 0; i < cfg->num_blocks; i++) {
+        cfg->blocks[i].idom = NULL;
+        cfg->blocks[i].num_children = 0;
+    }
+
+    // the entry is its own dominator while iterating
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < cfg->num_reachable; i++) {
+            BasicBlock *b = cfg->rpo[i];
+            BasicBlock *idom = NULL;
+            for (int j = 0; j < b->num_preds; j++) {
+                BasicBlock *p = b->preds[j];
+                if (p->idom == NULL)
+                    continue;
+                idom = idom == NULL ? p : intersect(p, idom);
+            }
+            if (b->idom != idom) {
+                b->idom = idom;
+                changed = true;
+            }
+        }
+    }
+    entry->idom = NULL;
+
+    // children are laid out in one slab, each block owning a contiguous run
+    free(cfg->dom_slab);
+    cfg->dom_slab = (BasicBlock **)malloc(cfg->num_blocks * sizeof(BasicBlock *));
+    for (int i = 1; i < cfg->num_reachable; i++)
+        cfg->rpo[i]->idom->num_children++;
+    int offset = 0;
+    for (int i = 0; i < cfg->num_reachable; i++) {
+        BasicBlock *b = cfg->rpo[i];
+        b->children = &cfg->dom_slab[offset];
+        offset += b->num_children;
+        b->num_children = 0;
+    }
+    for (int i = 1; i < cfg->num_reachable; i++) {
+        BasicBlock *idom = cfg->rpo[i]->idom;
+        idom->children[idom->num_children++] = cfg->rpo[i];
+    }
+}
+
+bool cfg_dominates(const BasicBlock *a, const BasicBlock *b) {
+    while (b != NULL && b->rpo > a->rpo)
+        b = b->idom;
+    return b == a;
+}
+
+bool cfg_natural_loop(const CFG *cfg, const BasicBlock *header, bool *body) {
+    BasicBlock **stack = (BasicBlock **)malloc(cfg->num_blocks * sizeof(BasicBlock *));
+    int top = 0;
+    memset(body, 0, cfg->num_blocks * sizeof(bool));
+
+    // walk backwards from the sources of the back edges, the header stops the walk
+    bool is_header = false;
+    body[header->id] = true;
+    for (int j = 0; j < header->num_preds; j++) {
+        BasicBlock *p = header->preds[j];
+        if (p->rpo < 0 || !cfg_dominates(header, p))
+            continue;
+        is_header = true;
+        if (!body[p->id]) {
+            body[p->id] = true;
+            stack[top++] = p;
+        }
+    }
+    while (top > 0) {
+        BasicBlock *b = stack[--top];
+        for (int j = 0; j < b->num_preds; j++) {
+            BasicBlock *p = b->preds[j];
+            if (p->rpo >= 0 && !body[p->id]) {
+                body[p->id] = true;
+                stack[top++] = p;
+            }
+        }
+    }
+
+    free(stack);
+    return is_header;
+}
+
+IRNode *cfg_loop_entry(const BasicBlock *header, const bool *body) {
+    BasicBlock *entry = NULL;
+    for (int j = 0; j < header->num_preds; j++) {
+        BasicBlock *p = header->preds[j];
+        if (p->rpo < 0 || body[p->id])
+            continue;
+        if (entry != NULL)
+            return NULL;
+        entry = p;
+    }
+    if (entry == NULL)
+        return NULL;
+
+    IRNode *term = block_terminator(entry);
+    if (term != NULL && term->instruction == JUMP)
+        return term;
+    // a branch to the header would need a block of its own
+    if (term != NULL && term->target != NULL && term->target->block == header)
+        return NULL;
+    return header->first;
+}
+
+void cfg_for_each_loop(IRFunction *fn,
+                       void (*visit)(CFG *cfg, BasicBlock *header, bool *body, void *data),
+                       void *data) {
+    int capacity = 8, num_done = 0;
+    IRNode **done = (IRNode **)malloc(capacity * sizeof(IRNode *));
+    while (true) {
+        CFG *cfg = build_cfg(fn);
+        cfg_dominators(cfg);
+
+        // an inner loop header comes after the outer one in reverse postorder
+        bool *body = (bool *)malloc(cfg->num_blocks * sizeof(bool));
+        BasicBlock *header = NULL;
+        for (int i = cfg->num_reachable - 1; i >= 0 && header == NULL; i--) {
+            BasicBlock *b = cfg->rpo[i];
+            bool seen = false;
+            for (int k = 0; k < num_done && !seen; k++)
+                seen = done[k] == block_label(b);
+            if (!seen && cfg_natural_loop(cfg, b, body))
+                header = b;
+        }
+
+        if (header != NULL) {
+            if (num_done == capacity) {
+                capacity *= 2;
+                done = (IRNode **)realloc(done, capacity * sizeof(IRNode *));
+            }
+            done[num_done++] = block_label(header);
+            visit(cfg, header, body, data);
+        }
+        free(body);
+        free_cfg(cfg);
+        if (header == NULL)
+            break;
+    }
+    free(done);
+}
+
+void free_cfg(CFG *cfg) {
+    if (cfg == NULL)
+        return;
+
+    for (int i = 0; i < cfg->num_blocks; i++) {
+        free(cfg->blocks[i].preds);
+    }
+    destroy_bitset_slab(cfg->sets);
+    free(cfg->dom_slab);
+    free(cfg->rpo);
+    free(cfg->blocks);
+    free(cfg);
+}
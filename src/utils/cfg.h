@@ -0,0 +1,201 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "bitset.h"
+#include "ir.h"
+#include <stdbool.h>
+
+/**
+ * @struct BasicBlock
+ * @brief Maximal straight-line sequence of IR instructions
+ *
+ * A block starts at a label or right after a jump/branch and ends at the
+ * next jump, branch or label. Control only enters through its first
+ * instruction and leaves through its last one, to at most two successors
+ * (the branch target and the fall-through).
+ */
+typedef struct BasicBlock {
+    int id;
+    IRNode *first, *last; /**< first and last instruction (inclusive) */
+
+    struct BasicBlock *succ[2];
+    int num_succs;
+    struct BasicBlock **preds;
+    int num_preds;
+    int cap_preds;
+
+    int rpo;        /**< position in reverse postorder, -1 when unreachable */
+    int loop_depth; /**< number of loops containing the block, see `cfg_loop_depth` */
+
+    struct BasicBlock *idom;       /**< immediate dominator, see `cfg_dominators` */
+    struct BasicBlock **children;  /**< blocks immediately dominated, in reverse postorder */
+    int num_children;
+
+    BitSet *use;      /**< registers read before being written in the block */
+    BitSet *def;      /**< registers written in the block */
+    BitSet *live_in;  /**< registers live at the block entry */
+    BitSet *live_out; /**< registers live at the block exit */
+} BasicBlock;
+
+/**
+ * @struct CFG
+ * @brief Control-flow graph of a single function
+ *
+ * Blocks are stored in instruction order, `blocks[0]` being the entry.
+ * While the graph exists, the `block` field of every instruction of the
+ * function points to the block that contains it.
+ */
+typedef struct CFG {
+    IRFunction *fn;
+
+    BasicBlock *blocks;
+    int num_blocks;
+
+    BasicBlock **rpo; /**< reachable blocks in reverse postorder */
+    int num_reachable;
+
+    BitSet *sets; /**< slab holding the liveness sets of every block */
+    struct BasicBlock **dom_slab; /**< slab holding the dominator tree children */
+} CFG;
+
+/**
+ * @brief Build the control-flow graph of a function
+ *
+ * Splits the instructions between the function entry and exit into basic
+ * blocks, links them through the targets of `JUMP` and `B*` instructions
+ * and their fall-through, and orders the reachable blocks in reverse
+ * postorder.
+ *
+ * @param fn Function to analyze
+ * @return Pointer to the new control-flow graph
+ */
+CFG *build_cfg(IRFunction *fn);
+
+/**
+ * @brief Last non-comment instruction of a block
+ *
+ * @param b Block to inspect
+ * @return The terminator of the block, or NULL if it only has comments
+ */
+IRNode *block_terminator(const BasicBlock *b);
+
+/**
+ * @brief Label starting a block
+ *
+ * @param b Block to inspect
+ * @return The label (only comments may precede it), or NULL if it has none
+ */
+IRNode *block_label(const BasicBlock *b);
+
+/**
+ * @brief Compute block-level liveness
+ *
+ * Computes the `use`/`def` sets of every block and then solves
+ * - live_out[b] = U live_in[s] for s in succ(b)
+ * - live_in[b] = use[b] U (live_out[b] - def[b])
+ * with a worklist seeded in postorder, so successors are visited before
+ * their predecessors and most blocks converge after a single visit.
+ * All sets live in a single slab allocated up front; the fixpoint loop
+ * updates them in place and allocates nothing.
+ *
+ * Uses and definitions are taken from `ir_uses` and `ir_defs`, so physical
+ * registers written or read implicitly (e.g. by `call`) are tracked too.
+ *
+ * @param cfg Control-flow graph of the function
+ * @param local Map from register ID to bit position (-1 to ignore). Physical
+ *              registers have negative IDs, so it must be valid from
+ *              `local[1 - NUM_REGISTERS]` on
+ * @param num_regs Number of bit positions
+ */
+void cfg_liveness(CFG *cfg, const int *local, int num_regs);
+
+/**
+ * @brief Compute the loop nesting depth of every block
+ *
+ * An edge to a block that does not come later in reverse postorder is a
+ * back edge (the code generator only emits reducible control flow, where
+ * `while` loops jump back to their `start_while` label). The natural loop
+ * of a header is made of the blocks that reach one of its back edges
+ * without going through the header, and the depth of a block is the number
+ * of natural loops it belongs to.
+ *
+ * @param cfg Control-flow graph of the function
+ */
+void cfg_loop_depth(CFG *cfg);
+
+/**
+ * @brief Compute the dominator tree
+ *
+ * Uses the iterative algorithm of Cooper, Harvey and Kennedy: blocks are
+ * visited in reverse postorder and the immediate dominator of each one is
+ * the nearest common ancestor, in the tree built so far, of its processed
+ * predecessors. It usually converges in two passes over the blocks.
+ * Sets `idom` (NULL for the entry and unreachable blocks) and the
+ * `children` of every block.
+ *
+ * @param cfg Control-flow graph of the function
+ */
+void cfg_dominators(CFG *cfg);
+
+/**
+ * @brief Check if a block dominates another one
+ *
+ * @param a Candidate dominator
+ * @param b Reachable block
+ * @return true if every path from the entry to `b` goes through `a`
+ */
+bool cfg_dominates(const BasicBlock *a, const BasicBlock *b);
+
+/**
+ * @brief Find the blocks of the natural loop of a header
+ *
+ * The loop is made of the header and the blocks reaching one of its back
+ * edges (from a block it dominates) without going through it. Needs the
+ * dominator tree (`cfg_dominators`).
+ *
+ * @param cfg Control-flow graph of the function
+ * @param header Candidate loop header
+ * @param body Block ID -> in the loop, filled for every block
+ * @return false if the block is not a loop header
+ */
+bool cfg_natural_loop(const CFG *cfg, const BasicBlock *header, bool *body);
+
+/**
+ * @brief Place of the preheader of a natural loop
+ *
+ * Code inserted before the returned node runs once each time the loop is
+ * entered, and nowhere else: right before the jump ending the only block
+ * entering the loop, or right before the header when that block falls
+ * through into it.
+ *
+ * @param header Loop header
+ * @param body Blocks of the loop, see `cfg_natural_loop`
+ * @return The node, or NULL if the loop is entered from several blocks or
+ *         through a branch to the header
+ */
+IRNode *cfg_loop_entry(const BasicBlock *header, const bool *body);
+
+/**
+ * @brief Visit each natural loop of a function, inner loops first
+ *
+ * The graph and its dominator tree are rebuilt before each visit, so the
+ * visitor may move, insert or remove instructions; headers are identified
+ * by their label across rebuilds, and each loop is visited once.
+ *
+ * @param fn Function to walk
+ * @param visit Called with the graph, the loop header, its blocks (see
+ *              `cfg_natural_loop`) and `data`; the graph is freed afterwards
+ * @param data Passed to `visit`
+ */
+void cfg_for_each_loop(IRFunction *fn,
+                       void (*visit)(CFG *cfg, BasicBlock *header, bool *body, void *data),
+                       void *data);
+
+/**
+ * @brief Free a control-flow graph and its liveness sets
+ *
+ * @param cfg Control-flow graph to free
+ */
+void free_cfg(CFG *cfg);
+
+#endif // CFG_H
@@ -1,5 +1,5 @@
 #include "ir.h"
-#include "bitset.h"
+#include "object_code.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,9 +8,12 @@ IR *new_ir() {
     IR *ir = (IR *)malloc(sizeof(IR));
     ir->head = NULL;
     ir->tail = NULL;
+    ir->functions = NULL;
+    ir->last_function = NULL;
     ir->next_temp_reg = 1;
     ir->next_while = 0;
     ir->next_if = 0;
+    ir->next_label = 0;
     ir->last_address = 0;
     return ir;
 }
@@ -30,6 +33,11 @@ int register_new_if(IR *ir) {
     return id;
 }
 
+int register_new_label(IR *ir) {
+    int id = ir->next_label++;
+    return id;
+}
+
 const char *instruction_to_string(Instruction instr) {
     switch (instr) {
     case MOV:
@@ -93,6 +101,9 @@ const char *instruction_to_string(Instruction instr) {
     case ECALL:
         return "ECALL";
 
+    case PHI:
+        return "PHI";
+
     default:
         return "UNKNOWN";
     }
@@ -206,6 +217,14 @@ void print_ir(IR *ir, FILE *out) {
                 fprintf(out, " %s", node->comment);
                 break;
 
+            case PHI:
+                print_register(out, node->dest);
+                for (int i = 0; i < node->num_args; i++) {
+                    fprintf(out, ", ");
+                    print_register(out, node->args[i]);
+                }
+                break;
+
             case ECALL:
             case NOP:
             default:
@@ -228,12 +247,19 @@ void free_ir(IR *ir) {
         next = node->next;
         if (node->comment != NULL)
             free(node->comment);
-        destroy_biset(node->live_in);
-        destroy_biset(node->live_out);
+        free(node->args);
         free(node);
         node = next;
     }
 
+    IRFunction *fn = ir->functions;
+    while (fn != NULL) {
+        IRFunction *next_fn = fn->next;
+        free(fn->name);
+        free(fn);
+        fn = next_fn;
+    }
+
     free(ir);
 }
 
@@ -242,8 +268,7 @@ IRNode *new_ir_node(Instruction instruction) {
     node->next = NULL;
     node->prev = NULL;
     node->target = NULL;
-    node->live_in = NULL;
-    node->live_out = NULL;
+    node->block = NULL;
     node->instruction = instruction;
     node->src_kind = CONST_SRC;
     node->dest = X0_REGISTER;
@@ -252,6 +277,8 @@ IRNode *new_ir_node(Instruction instruction) {
     node->imm = 0;
     node->address = -1;
     node->comment = NULL;
+    node->args = NULL;
+    node->num_args = 0;
     return node;
 }
 
@@ -270,6 +297,170 @@ void ir_insert_node(IR *ir, IRNode *node) {
     }
 }
 
+void ir_insert_before(IR *ir, IRNode *pos, IRNode *node) {
+    node->next = pos;
+    node->prev = pos->prev;
+    if (pos->prev == NULL)
+        ir->head = node;
+    else
+        pos->prev->next = node;
+    pos->prev = node;
+}
+
+void ir_insert_after(IR *ir, IRNode *pos, IRNode *node) {
+    node->prev = pos;
+    node->next = pos->next;
+    if (pos->next == NULL)
+        ir->tail = node;
+    else
+        pos->next->prev = node;
+    pos->next = node;
+}
+
+void ir_renumber(IR *ir) {
+    ir->last_address = 0;
+    for (IRNode *node = ir->head; node != NULL; node = node->next) {
+        if (node->instruction != COMMENT) {
+            node->address = ir->last_address;
+            ir->last_address += 4;
+        }
+    }
+}
+
+void ir_remove(IR *ir, IRNode *node) {
+    if (node->prev == NULL)
+        ir->head = node->next;
+    else
+        node->prev->next = node->next;
+    if (node->next == NULL)
+        ir->tail = node->prev;
+    else
+        node->next->prev = node->prev;
+
+    if (node->comment != NULL)
+        free(node->comment);
+    free(node->args);
+    free(node);
+}
+
+IRFunction *ir_new_function(IR *ir, char *name, IRNode *entry) {
+    IRFunction *fn = (IRFunction *)malloc(sizeof(IRFunction));
+    fn->name = strdup(name);
+    fn->entry = entry;
+    fn->prologue = entry;
+    fn->frame = NULL;
+    fn->epilogue = NULL;
+    fn->exit = NULL;
+    fn->frame_size = 0;
+    fn->next = NULL;
+
+    if (ir->functions == NULL)
+        ir->functions = fn;
+    else
+        ir->last_function->next = fn;
+    ir->last_function = fn;
+
+    return fn;
+}
+
+int ir_alloc_frame_slot(IR *ir, IRFunction *fn) {
+    fn->frame_size += 4;
+
+    if (fn->frame == NULL) {
+        IRNode *node = new_ir_node(ADD);
+        node->dest = SP_REGISTER;
+        node->src1 = SP_REGISTER;
+        node->src_kind = CONST_SRC;
+        ir_insert_after(ir, fn->prologue, node);
+        fn->frame = node;
+        fn->prologue = node;
+    }
+    fn->frame->imm = -fn->frame_size;
+
+    return -fn->frame_size;
+}
+
+int ir_uses(const IRNode *node, int *regs) {
+    int n = 0;
+    if (node->src1 != X0_REGISTER)
+        regs[n++] = node->src1;
+    if (node->src2 != X0_REGISTER && node->src2 != node->src1)
+        regs[n++] = node->src2;
+
+    if (node->instruction == ECALL) {
+        regs[n++] = A0_REGISTER;
+        regs[n++] = A7_REGISTER;
+    } else if (node->instruction == CALL) {
+        for (int i = 0; i < node->imm; i++)
+            regs[n++] = A0_REGISTER - i;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Registers a callee is free to overwrite: ra, t0-t6 and a0-a7
+ */
+static const int caller_saved[] = {-1,  -5,  -6,  -7,  -28, -29, -30, -31,
+                                   -10, -11, -12, -13, -14, -15, -16, -17};
+
+int ir_defs(const IRNode *node, int *regs) {
+    int n = 0;
+    if (node->dest != X0_REGISTER)
+        regs[n++] = node->dest;
+
+    if (node->instruction == CALL) {
+        for (size_t i = 0; i < sizeof(caller_saved) / sizeof(caller_saved[0]); i++)
+            regs[n++] = caller_saved[i];
+    } else if (node->instruction == ECALL) {
+        regs[n++] = A0_REGISTER;
+    }
+
+    return n;
+}
+
+Instruction ir_inverse_branch(Instruction instruction) {
+    switch (instruction) {
+    case BEQ:
+        return BNE;
+    case BNE:
+        return BEQ;
+    case BLT:
+        return BGE;
+    case BGE:
+        return BLT;
+    case BLE:
+        return BGT;
+    default:
+        return BLE;
+    }
+}
+
+bool ir_is_pure(const IRNode *node) {
+    switch (node->instruction) {
+    case MOV:
+    case LI:
+    case LUI:
+    case AUIPC:
+    case LOAD:
+    case ADD:
+    case SUB:
+    case MUL:
+    case DIV:
+    case REM:
+    case SLL:
+    case SRA:
+    case SRL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool ir_fits_immediate(long value) {
+    return value >= LOWER_LIMIT && value <= UPPER_LIMIT;
+}
+
 void ir_insert_mov(IR *ir, int dest, int src1) {
     IRNode *node = new_ir_node(MOV);
     node->src_kind = REG_SRC;
@@ -377,7 +568,7 @@ void ir_insert_div(IR *ir, int dest, int src1, int src2) {
     ir_insert_node(ir, node);
 }
 
-void ir_insert_rem(IR *ir, int src1, int src2, int dest) {
+void ir_insert_rem(IR *ir, int dest, int src1, int src2) {
     IRNode *node = new_ir_node(REM);
     node->dest = dest;
     node->src_kind = REG_SRC;
@@ -478,12 +669,13 @@ IRNode *ir_insert_jump(IR *ir, char* label) {
     return node;
 }
 
-void ir_insert_jump_reg(IR *ir, int src1) {
+IRNode *ir_insert_jump_reg(IR *ir, int src1) {
     IRNode *node = new_ir_node(JUMP_REG);
     node->src_kind = REG_SRC;
     node->src1 = src1;
 
     ir_insert_node(ir, node);
+    return node;
 }
 
 IRNode *ir_insert_beq(IR *ir, int src1, int src2, int imm) {
@@ -552,9 +744,10 @@ IRNode *ir_insert_bgt(IR *ir, int src1, int src2, int imm) {
     return node;
 }
 
-void ir_insert_call(IR *ir, char *label) {
+void ir_insert_call(IR *ir, char *label, int num_args) {
     IRNode *node = new_ir_node(CALL);
     node->src_kind = CONST_SRC;
+    node->imm = num_args;
     node->comment = strdup(label);
 
     ir_insert_node(ir, node);
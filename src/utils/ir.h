@@ -1,7 +1,6 @@
 #ifndef IR_H
 #define IR_H
 
-#include "bitset.h"
 #include "symtab.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +12,7 @@
  * @{
  */
 #define SP_REGISTER -2  /**< Stack pointer register */
+#define GP_REGISTER -3  /**< Global pointer register, holds GLOBAL_BASE */
 #define A0_REGISTER -10 /**< Argument/return value register 0 */
 #define A1_REGISTER -11 /**< Argument/return value register 1 */
 #define A7_REGISTER -17 /**< Argument register 7 (syscall number) */
@@ -20,6 +20,7 @@
 #define FP_REGISTER -8  /**< Frame pointer register */
 #define RA_REGISTER -1  /**< Return address register */
 #define T0_REGISTER -5  /**< Temporary register 0 */
+#define NUM_REGISTERS 32 /**< Number of integer registers (physical IDs 0 to -31) */
 /** @} */
 
 /**
@@ -65,7 +66,9 @@ typedef enum Instruction {
     BGT,
 
     CALL,
-    ECALL
+    ECALL,
+
+    PHI
 } Instruction;
 
 /**
@@ -73,8 +76,14 @@ typedef enum Instruction {
  * @brief Single instruction node in the IR linked list
  *
  * Represents one instruction with all its operands, addressing information,
- * and links to adjacent instructions. Also includes liveness analysis data
- * for register allocation optimization.
+ * and links to adjacent instructions. While a control-flow graph of its
+ * function exists, `block` points to the basic block holding the instruction.
+ *
+ * A `PHI` (only present while the function is in SSA form, see ssa.h)
+ * merges one register per predecessor of its block: `args[i]` is the value
+ * flowing in from `block->preds[i]` and `imm` the register it was created
+ * for. A `call` keeps in `imm` the number of arguments it passes in
+ * registers.
  */
 typedef struct IRNode {
     struct IRNode *next, *prev;
@@ -90,9 +99,34 @@ typedef struct IRNode {
     char *comment;
     int address;
 
-    BitSet *live_in, *live_out;
+    int *args;    /**< `PHI` operands, NULL for other instructions */
+    int num_args;
+
+    struct BasicBlock *block;
 } IRNode;
 
+/**
+ * @struct IRFunction
+ * @brief Frame bookkeeping for one function in the IR
+ *
+ * Records the nodes that delimit a function (its entry label and the final
+ * `jalr`) and the prologue instruction that reserves the local area below
+ * `fp`, so later passes can grow the frame (e.g. for spill slots).
+ */
+typedef struct IRFunction {
+    char *name;
+
+    IRNode *entry;    /**< function label */
+    IRNode *prologue; /**< last instruction of the frame setup */
+    IRNode *frame;    /**< `addi sp, sp, -frame_size`, NULL while the frame is empty */
+    IRNode *epilogue; /**< `end_<name>` label, start of the frame teardown */
+    IRNode *exit;     /**< `jalr` back to the caller */
+
+    int frame_size; /**< bytes reserved below `fp` (locals and spill slots) */
+
+    struct IRFunction *next;
+} IRFunction;
+
 /**
  * @struct IntermediateRepresentation
  * @brief Main IR structure containing instruction list and metadata
@@ -104,9 +138,13 @@ typedef struct IntermediateRepresentation {
     struct IRNode *head;
     struct IRNode *tail;
 
+    struct IRFunction *functions;
+    struct IRFunction *last_function;
+
     int next_temp_reg;
     int next_while;
     int next_if;
+    int next_label;
     int last_address;
 } IR;
 
@@ -150,6 +188,16 @@ int register_new_while(IR *ir);
  */
 int register_new_if(IR *ir);
 
+/**
+ * @brief Register a new label for code created by optimization passes
+ *
+ * Generates a unique label ID and increments the counter.
+ *
+ * @param ir Pointer to IR structure
+ * @return Unique label ID
+ */
+int register_new_label(IR *ir);
+
 /**
  * @brief Print IR instructions to file
  *
@@ -165,7 +213,7 @@ void print_ir(IR *ir, FILE *out);
  * @brief Free IR structure and all nodes
  *
  * Deallocates the entire IR structure including all instruction nodes
- * and their associated memory (comments, bitsets).
+ * and their associated memory (comments, function records).
  *
  * @param ir Pointer to IR structure to free
  */
@@ -194,15 +242,133 @@ IRNode *new_ir_node(Instruction instruction);
 void ir_insert_node(IR *ir, IRNode *node);
 
 /**
- * @brief Insert node into IR instruction list
+ * @brief Insert node before a given position
  *
- * Adds the specified node to the end of the IR instruction list
- * and assigns it an address (except for COMMENT instructions).
+ * Links the node into the instruction list right before `pos`. The node
+ * is not given an address, since it is placed in the middle of the list.
  *
  * @param ir Pointer to IR structure
+ * @param pos Node that will follow the inserted one
  * @param node Pointer to node to insert
  */
-void ir_insert_node(IR *ir, IRNode *node);
+void ir_insert_before(IR *ir, IRNode *pos, IRNode *node);
+
+/**
+ * @brief Insert node after a given position
+ *
+ * Links the node into the instruction list right after `pos`. The node
+ * is not given an address, since it is placed in the middle of the list.
+ *
+ * @param ir Pointer to IR structure
+ * @param pos Node that will precede the inserted one
+ * @param node Pointer to node to insert
+ */
+void ir_insert_after(IR *ir, IRNode *pos, IRNode *node);
+
+/**
+ * @brief Reassign instruction addresses in list order
+ *
+ * Nodes linked in the middle of the list (e.g. spill code) have no address.
+ * This gives every non-comment node its address again, 4 bytes apart, as
+ * `ir_insert_node` does.
+ *
+ * @param ir Pointer to IR structure
+ */
+void ir_renumber(IR *ir);
+
+/**
+ * @brief Unlink a node from the instruction list and free it
+ *
+ * @param ir Pointer to IR structure
+ * @param node Node to remove
+ */
+void ir_remove(IR *ir, IRNode *node);
+
+/**
+ * @brief Register a new function in the IR
+ *
+ * Appends a frame record for the function starting at the given label.
+ * The remaining fields are filled by the code generator as the prologue
+ * and epilogue are emitted.
+ *
+ * @param ir Pointer to IR structure
+ * @param name Function name
+ * @param entry Label node of the function
+ * @return Pointer to the new function record
+ */
+IRFunction *ir_new_function(IR *ir, char *name, IRNode *entry);
+
+/**
+ * @brief Reserve a new 4-byte slot in a function frame
+ *
+ * Grows the local area of the function and updates (or creates) the
+ * `addi sp, sp, -frame_size` instruction of its prologue.
+ *
+ * @param ir Pointer to IR structure
+ * @param fn Function whose frame is extended
+ * @return Offset of the new slot relative to `fp`
+ */
+int ir_alloc_frame_slot(IR *ir, IRFunction *fn);
+
+/**
+ * @brief Registers read by an instruction
+ *
+ * Lists the register operands of the instruction together with the ones it
+ * reads implicitly: `ecall` reads `a0` and `a7`, and `call` the argument
+ * registers `a0` to `a<imm-1>`. The return `jalr` of a
+ * function that returns a value carries `a0` as `src2`, so it is reported
+ * like any other operand. `x0` is never reported. The operands of a `PHI`
+ * are read on the incoming edges, not by the instruction, and are not
+ * reported either.
+ *
+ * @param node Instruction to inspect
+ * @param regs Output array with room for `NUM_REGISTERS` entries
+ * @return Number of registers written to `regs`
+ */
+int ir_uses(const IRNode *node, int *regs);
+
+/**
+ * @brief Registers written by an instruction
+ *
+ * Lists the destination of the instruction together with the registers it
+ * writes implicitly: `call` clobbers every caller-saved register (`ra`,
+ * `t0`-`t6` and `a0`-`a7`, the return value included), and `ecall` may
+ * write its result to `a0`. `x0` is never reported.
+ *
+ * @param node Instruction to inspect
+ * @param regs Output array with room for `NUM_REGISTERS` entries
+ * @return Number of registers written to `regs`
+ */
+int ir_defs(const IRNode *node, int *regs);
+
+/**
+ * @brief Branch taken when the condition of another one is false
+ *
+ * @param instruction Conditional branch (`BEQ` to `BGT`)
+ * @return The branch with the opposite condition
+ */
+Instruction ir_inverse_branch(Instruction instruction);
+
+/**
+ * @brief Check if an instruction only computes its destination register
+ *
+ * Moves, constants, loads and arithmetic are pure: running one again, or
+ * not at all when its result is unread, changes nothing else. `PHI` is
+ * left out, as it is not executed where it appears.
+ *
+ * @param node Instruction to inspect
+ * @return true if the instruction is pure
+ */
+bool ir_is_pure(const IRNode *node);
+
+/**
+ * @brief Check if a value fits in the 12-bit signed immediate of an
+ *        I-type or S-type instruction
+ *
+ * @param value Value to check
+ * @return true if `value` is within `LOWER_LIMIT` and `UPPER_LIMIT`
+ */
+bool ir_fits_immediate(long value);
 
 /** @name Data Movement Instructions
  * @brief Functions for inserting data movement instructions
@@ -421,8 +587,9 @@ IRNode *ir_insert_jump(IR *ir, char *label);
  * @brief Insert jump to register: ra ← pc + 4; pc ← rs1
  * @param ir Pointer to IR structure
  * @param src1 Register containing target address
+ * @return Pointer to the created jump node
  */
-void ir_insert_jump_reg(IR *ir, int src1);
+IRNode *ir_insert_jump_reg(IR *ir, int src1);
 
 /**
  * @brief Insert branch if equal: if rs1 == rs2 then pc ← pc + imm
@@ -495,8 +662,9 @@ IRNode *ir_insert_bgt(IR *ir, int src1, int src2, int imm);
  * @brief Insert function call
  * @param ir Pointer to IR structure
  * @param label Function name to call
+ * @param num_args Number of arguments passed in registers, from `a0` on
  */
-void ir_insert_call(IR *ir, char *label);
+void ir_insert_call(IR *ir, char *label, int num_args);
 
 /**
  * @brief Insert system call
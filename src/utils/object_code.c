@@ -6,7 +6,6 @@
 #include <string.h>
 
 char *get_reg(int *map, int reg_idx) {
-    int temps[7] = {-5, -6, -7, -28, -29, -30, -31};
     char *reg_names[32] = {"zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "fp", "s1", "a0",
                            "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
                            "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
@@ -14,7 +13,7 @@ char *get_reg(int *map, int reg_idx) {
     if (reg_idx <= 0)
         return reg_names[-reg_idx];
 
-    return reg_names[-temps[map[reg_idx]]];
+    return reg_names[-map[reg_idx]];
 }
 
 ObjectCode *new_obj_code() {
@@ -66,7 +65,9 @@ ObjectCode *ir_to_obj_code(IR *ir, int *map, bool include_comments) {
             //             get_reg(map, node->dest), lower);
             // }
 
-            sprintf(curr_obj->assembly, "li %s, 0x%lx", get_reg(map, node->dest), node->imm);
+            // registers are 32 bits wide, negative constants print as such
+            sprintf(curr_obj->assembly, "li %s, 0x%x", get_reg(map, node->dest),
+                    (unsigned int)node->imm);
             break;
         case LUI:
             sprintf(curr_obj->assembly, "lui %s, %ld", get_reg(map, node->dest), node->imm);
@@ -190,6 +191,9 @@ ObjectCode *ir_to_obj_code(IR *ir, int *map, bool include_comments) {
         case ECALL:
             sprintf(curr_obj->assembly, "ecall");
             break;
+        case PHI:
+            // phis are replaced by copies before register allocation
+            break;
         }
 
         i++;
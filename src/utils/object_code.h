@@ -41,7 +41,7 @@ ObjectCode *new_obj_code();
  * to convert virtual registers to physical RISC-V registers.
  *
  * @param ir Pointer to IR structure containing instruction list to convert
- * @param map Array mapping virtual register indices to physical register indices
+ * @param map Array mapping virtual register IDs to physical register IDs
  * @param include_comments Whether to include comment instructions in output
  * @return Pointer to head of ObjectCode linked list, or NULL on failure
  */
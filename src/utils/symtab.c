@@ -39,6 +39,7 @@ void st_insert(ASTNode *node, int scope, unsigned int addr, int offset) {
         l->active = true;
         l->offset = offset;
         l->address = addr;
+        l->reg = 0;
 
         l->lines = (LineList *)malloc(sizeof(LineList));
         l->lines->lineno = node->lineno;
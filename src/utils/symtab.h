@@ -12,6 +12,15 @@
    in hash function  */
 #define SHIFT 4
 
+/* GLOBAL_BASE is the address of the first
+   global variable, held in gp at run time */
+#define GLOBAL_BASE 0x10008000
+
+/* ARG_REGISTERS is the number of parameters
+   passed in registers (a0-a7), the next ones
+   are passed on the stack */
+#define ARG_REGISTERS 8
+
 /* the list of line numbers of the source
  * code in which a variable is referenced
  */
@@ -33,6 +42,7 @@ typedef struct BucketListRec {
     bool active;
     int offset;           /* stack offset */
     unsigned int address; /* memory location for global variable */
+    int reg;              /* virtual register of a promoted scalar, 0 if in memory */
     struct BucketListRec *next;
 } BucketList;
 
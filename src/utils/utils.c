@@ -345,6 +345,11 @@ void print_help(const char *program_name) {
     printf("  --tp      Enable tracing of the parser\n");
     printf("  --ta      Enable tracing of the analyzer\n");
     printf("  --tc      Enable tracing of the code generation\n");
+    printf("  --regs=N  Limit the register allocator to N registers (3-26)\n");
+    printf("  --ra=ALG  Register allocator: color (default), linear (faster) or irc\n");
+    printf("  --ra-stats  Report the registers spilled by the allocator and their costs\n");
+    printf("  --peephole-stats  Report how often each peephole rule fired (-O1 and up)\n");
+    printf("  -O<n>     Optimization level 0-2 (-O2 uses the irc allocator)\n");
     printf("  --help    Show this help message\n");
 }
 